@@ -0,0 +1,137 @@
+// Culls every instance and appends the visible ones to the instance list
+// of their draw, bumping that draw's instance count. Runs twice a frame:
+// the early phase redraws what was visible last frame, the late phase
+// tests everything against the depth pyramid built from the early depth,
+// draws what became visible and records visibility for the next frame.
+
+#define PHASE_EARLY 0
+#define PHASE_LATE  1
+
+struct Instance {
+	float4 model[3];
+	float4 sphere;
+	uint draw;
+	uint material;
+	uint2 padding;
+};
+
+struct DrawCommand {
+	uint num_indices;
+	uint num_instances;
+	uint first_index;
+	int vertex_offset;
+	uint first_instance;
+};
+
+Texture2D<float> hiz : register(t0, space0);
+SamplerState hiz_sampler : register(s0, space0);
+StructuredBuffer<Instance> instances : register(t1, space0);
+StructuredBuffer<uint> draw_first : register(t2, space0);
+RWStructuredBuffer<DrawCommand> draws : register(u0, space1);
+RWStructuredBuffer<uint> visible : register(u1, space1);
+RWStructuredBuffer<uint> visibility : register(u2, space1);
+
+cbuffer CullUBO : register(b0, space2) {
+	float4 planes[6];
+	float4x4 view;
+	float proj_x;
+	float proj_y;
+	float znear;
+	float zfar;
+	uint instance_count;
+	uint instance_base;
+	uint draw_first_base;
+	uint phase;
+	uint draw_base;
+	uint visible_base;
+	uint history;
+	uint occlusion;
+};
+
+bool frustum_visible(float4 sphere) {
+	[unroll]
+	for (uint p = 0; p < 6; p++) {
+		if (dot(planes[p].xyz, sphere.xyz) + planes[p].w < -sphere.w) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// x extent of the sphere's silhouette after projection, from the two
+// tangent lines through the eye in the plane of axis and z
+float2 project_extent(float2 c, float r, float scale) {
+	float t = sqrt(dot(c, c) - r * r);
+	float2 lo = float2(t * c.x - r * c.y, r * c.x + t * c.y);
+	float2 hi = float2(t * c.x + r * c.y, -r * c.x + t * c.y);
+	float a = lo.x / lo.y * scale;
+	float b = hi.x / hi.y * scale;
+	return float2(min(a, b), max(a, b));
+}
+
+bool occluded(float4 sphere) {
+	float3 c = mul(view, float4(sphere.xyz, 1)).xyz;
+	float r = sphere.w;
+	if (c.z - r < znear) {
+		return false;
+	}
+
+	float2 x = project_extent(c.xz, r, proj_x);
+	float2 y = project_extent(c.yz, r, proj_y);
+	float4 rect = saturate(float4(x.x, -y.y, x.y, -y.x) * 0.5 + 0.5);
+
+	uint width, height, levels;
+	hiz.GetDimensions(0, width, height, levels);
+	float2 size = (rect.zw - rect.xy) * float2(width, height);
+	float level = clamp(ceil(log2(max(max(size.x, size.y), 1))), 0, levels - 1);
+
+	// the rect spans at most two texels per axis at this level
+	hiz.GetDimensions((uint) level, width, height, levels);
+	float2 texel = 1.0 / float2(width, height);
+	float2 p0 = (floor(rect.xy / texel) + 0.5) * texel;
+	float2 p1 = (floor(min(rect.zw / texel, float2(width, height) - 1)) + 0.5) * texel;
+	float depth = max(max(hiz.SampleLevel(hiz_sampler, p0, level),
+	                      hiz.SampleLevel(hiz_sampler, float2(p1.x, p0.y), level)),
+	                  max(hiz.SampleLevel(hiz_sampler, float2(p0.x, p1.y), level),
+	                      hiz.SampleLevel(hiz_sampler, p1, level)));
+
+	float near_z = c.z - r;
+	float sphere_depth = zfar * (near_z - znear) / (near_z * (zfar - znear));
+	return sphere_depth > depth;
+}
+
+[numthreads(64, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID) {
+	if (id.x >= instance_count) {
+		return;
+	}
+
+	uint index = instance_base + id.x;
+	Instance instance = instances[index];
+	bool was_visible = history != 0 && visibility[id.x] != 0;
+
+	if (phase == PHASE_EARLY && !was_visible) {
+		return;
+	}
+
+	bool is_visible = frustum_visible(instance.sphere);
+	if (phase == PHASE_LATE) {
+		if (is_visible && occlusion != 0) {
+			is_visible = !occluded(instance.sphere);
+		}
+		visibility[id.x] = is_visible ? 1 : 0;
+
+		// drawn in the early phase already
+		if (was_visible) {
+			return;
+		}
+	}
+
+	if (!is_visible) {
+		return;
+	}
+
+	uint slot;
+	InterlockedAdd(draws[draw_base + instance.draw].num_instances, 1, slot);
+	visible[visible_base + draw_first[draw_first_base + instance.draw] + slot] = index;
+}
@@ -0,0 +1,5 @@
+// fragment stage of the depth prepass, depth is written by the fixed
+// function, there is no color target
+
+void main() {
+}
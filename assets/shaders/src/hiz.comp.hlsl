@@ -0,0 +1,38 @@
+// Builds one level of the hierarchical depth buffer. Every texel keeps the
+// farthest depth of the source texels it covers, odd sizes make that up to
+// three per axis, so a rect tested against it is never wrongly occluded.
+// src_size is the region read from the source level, for level 0 that is
+// the part of the depth texture the scene was rendered to.
+
+Texture2D<float> src : register(t0, space0);
+SamplerState src_sampler : register(s0, space0);
+RWTexture2D<float> dst : register(u0, space1);
+
+cbuffer HiZUBO : register(b0, space2) {
+	uint2 src_size;
+	uint2 dst_size;
+	uint src_level;
+};
+
+[numthreads(8, 8, 1)]
+void main(uint3 id : SV_DispatchThreadID) {
+	if (id.x >= dst_size.x || id.y >= dst_size.y) {
+		return;
+	}
+
+	uint width, height, levels;
+	src.GetDimensions(src_level, width, height, levels);
+	float2 texture_size = float2(width, height);
+
+	uint2 lo = id.xy * src_size / dst_size;
+	uint2 hi = min(((id.xy + 1) * src_size + dst_size - 1) / dst_size, src_size);
+
+	float depth = 0;
+	for (uint y = lo.y; y < hi.y; y++) {
+		for (uint x = lo.x; x < hi.x; x++) {
+			float2 uv = (float2(x, y) + 0.5) / texture_size;
+			depth = max(depth, src.SampleLevel(src_sampler, uv, src_level));
+		}
+	}
+	dst[id.xy] = depth;
+}
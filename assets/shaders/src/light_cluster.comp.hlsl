@@ -0,0 +1,145 @@
+// Assigns the lights to the clusters of the view frustum: CLUSTER_X x
+// CLUSTER_Y screen tiles over the render area, each split into CLUSTER_Z
+// slices spaced exponentially in view depth. One thread per cluster, the
+// lights are transformed to view space once per group and staged through
+// groupshared memory. Every cluster counts its lights, reserves a range of
+// the shared index list and fills it in a second pass, so the lists are
+// compact no matter how the lights are spread.
+
+// must match CLUSTER_X/Y/Z in common.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define GROUP_SIZE 64
+
+struct Light {
+	float3 position;
+	float range;
+	float3 color;
+	float spot_scale;
+	float3 direction;
+	float spot_offset;
+};
+
+StructuredBuffer<Light> lights : register(t0, space0);
+RWStructuredBuffer<uint2> clusters : register(u0, space1);
+RWStructuredBuffer<uint> light_indices : register(u1, space1);
+RWStructuredBuffer<uint> counter : register(u2, space1);
+
+cbuffer ClusterUBO : register(b0, space2) {
+	float4x4 view;
+	float proj_x;
+	float proj_y;
+	float znear;
+	float zfar;
+	float2 render_size;
+	uint light_base;
+	uint light_count;
+	uint index_capacity;
+	uint3 padding;
+};
+
+groupshared float4 shared_spheres[GROUP_SIZE];  // view-space position, range
+groupshared float4 shared_cones[GROUP_SIZE];    // view-space axis, cos of the outer angle, -2 for point lights
+
+float slice_depth(uint slice) {
+	return znear * pow(zfar / znear, slice / (float) CLUSTER_Z);
+}
+
+void stage(uint index, uint local) {
+	if (index >= light_count) {
+		return;
+	}
+	Light light = lights[light_base + index];
+	float3 position = mul(view, float4(light.position, 1)).xyz;
+	float3 direction = mul((float3x3) view, light.direction);
+	float cos_outer = light.spot_scale > 0 ? -light.spot_offset / light.spot_scale : -2;
+	shared_spheres[local] = float4(position, light.range);
+	shared_cones[local] = float4(direction, cos_outer);
+}
+
+bool sphere_touches_box(float4 sphere, float3 lo, float3 hi) {
+	float3 d = max(max(lo - sphere.xyz, 0), sphere.xyz - hi);
+	return dot(d, d) <= sphere.w * sphere.w;
+}
+
+// the cone against the bounding sphere of the cluster
+bool cone_touches_sphere(float3 apex, float3 axis, float range, float cos_angle, float4 sphere) {
+	float3 v = sphere.xyz - apex;
+	float v_len_sq = dot(v, v);
+	float along = dot(v, axis);
+	float sin_angle = sqrt(saturate(1 - cos_angle * cos_angle));
+	float closest = cos_angle * sqrt(max(v_len_sq - along * along, 0)) - along * sin_angle;
+	return closest <= sphere.w && along <= sphere.w + range && along >= -sphere.w;
+}
+
+bool light_touches(uint i, float3 lo, float3 hi) {
+	float4 sphere = shared_spheres[i];
+	if (!sphere_touches_box(sphere, lo, hi)) {
+		return false;
+	}
+	float4 cone = shared_cones[i];
+	if (cone.w < -1) {
+		return true;
+	}
+	float3 center = (lo + hi) * 0.5;
+	return cone_touches_sphere(sphere.xyz, cone.xyz, sphere.w, cone.w, float4(center, length(hi - center)));
+}
+
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID, uint3 local : SV_GroupThreadID) {
+	uint cluster = id.x;
+	bool active = cluster < CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+	uint x = cluster % CLUSTER_X;
+	uint y = (cluster / CLUSTER_X) % CLUSTER_Y;
+	uint z = cluster / (CLUSTER_X * CLUSTER_Y);
+
+	// tile corners in ndc, y up, pushed out to both slice depths; the view
+	// space x of an ndc x at depth z is x * z / proj_x
+	float2 tile = render_size / float2(CLUSTER_X, CLUSTER_Y);
+	float2 px_lo = float2(x, y) * tile;
+	float2 px_hi = px_lo + tile;
+	float2 ndc_lo = float2(px_lo.x / render_size.x * 2 - 1, 1 - px_hi.y / render_size.y * 2);
+	float2 ndc_hi = float2(px_hi.x / render_size.x * 2 - 1, 1 - px_lo.y / render_size.y * 2);
+	float2 a = ndc_lo / float2(proj_x, proj_y);
+	float2 b = ndc_hi / float2(proj_x, proj_y);
+	float z0 = slice_depth(z);
+	float z1 = slice_depth(z + 1);
+	float3 lo = float3(min(a * z0, a * z1), z0);
+	float3 hi = float3(max(b * z0, b * z1), z1);
+
+	uint count = 0;
+	for (uint base = 0; base < light_count; base += GROUP_SIZE) {
+		stage(base + local.x, local.x);
+		GroupMemoryBarrierWithGroupSync();
+		uint batch = min(GROUP_SIZE, light_count - base);
+		for (uint i = 0; active && i < batch; i++) {
+			if (light_touches(i, lo, hi)) {
+				count++;
+			}
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	// clusters past the end of the list keep what fits
+	uint offset = 0;
+	if (active) {
+		InterlockedAdd(counter[0], count, offset);
+		count = min(count, index_capacity - min(offset, index_capacity));
+		clusters[cluster] = uint2(offset, count);
+	}
+
+	uint written = 0;
+	for (uint base = 0; base < light_count; base += GROUP_SIZE) {
+		stage(base + local.x, local.x);
+		GroupMemoryBarrierWithGroupSync();
+		uint batch = min(GROUP_SIZE, light_count - base);
+		for (uint i = 0; active && i < batch && written < count; i++) {
+			if (light_touches(i, lo, hi)) {
+				light_indices[offset + written] = base + i;
+				written++;
+			}
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+}
@@ -1,11 +1,130 @@
+// feature bits come from the build as -D defines, see build.ps1
+// TEXTURED: base color and texture array layer from the material table
+// LIT: ambient and shadowed moon light plus the point and spot lights of
+// the fragment's cluster, as assigned by light_cluster.comp
+
 struct Input {
+	float4 position : SV_Position;
 	float4 color : TEXCOORD0;
 	float2 uv : TEXCOORD1;
+#ifdef LIT
+	float3 normal : TEXCOORD2;
+	float3 world : TEXCOORD3;
+	float view_z : TEXCOORD4;
+#endif
+#ifdef TEXTURED
+	nointerpolation uint material : TEXCOORD5;
+#endif
+};
+
+struct Material {
+	float4 base_color;
+	uint layer;
+	uint3 padding;
 };
 
-Texture2D<float4> tex : register(t0, space2);
+// must match CLUSTER_X/Y/Z in common.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+
+struct Light {
+	float3 position;
+	float range;
+	float3 color;
+	float spot_scale;
+	float3 direction;
+	float spot_offset;
+};
+
+// sampled textures first, then the storage buffers
+#if defined(TEXTURED) && defined(LIT)
+Texture2DArray<float4> tex : register(t0, space2);
+SamplerState smp : register(s0, space2);
+Texture2D<float> shadow_map : register(t1, space2);
+SamplerComparisonState shadow_sampler : register(s1, space2);
+StructuredBuffer<Material> materials : register(t2, space2);
+StructuredBuffer<Light> lights : register(t3, space2);
+StructuredBuffer<uint2> clusters : register(t4, space2);
+StructuredBuffer<uint> light_indices : register(t5, space2);
+#elif defined(TEXTURED)
+Texture2DArray<float4> tex : register(t0, space2);
 SamplerState smp : register(s0, space2);
+StructuredBuffer<Material> materials : register(t1, space2);
+#elif defined(LIT)
+Texture2D<float> shadow_map : register(t0, space2);
+SamplerComparisonState shadow_sampler : register(s0, space2);
+StructuredBuffer<Light> lights : register(t1, space2);
+StructuredBuffer<uint2> clusters : register(t2, space2);
+StructuredBuffer<uint> light_indices : register(t3, space2);
+#endif
+
+#ifdef LIT
+cbuffer LightUBO : register(b0, space3) {
+	float4x4 shadow_view_proj;
+	float2 tile_size;
+	float slice_scale;
+	float slice_bias;
+	float3 ambient;
+	uint light_base;
+	float3 moon_direction;      // towards the moon
+	float padding0;
+	float3 moon_color;
+	float shadow_normal_offset;
+};
+
+// outside the map is lit
+float moon_shadow(float3 world, float3 n) {
+	float4 p = mul(shadow_view_proj, float4(world + n * shadow_normal_offset, 1));
+	float2 uv = p.xy * float2(0.5, -0.5) + 0.5;
+	if (any(uv < 0) || any(uv > 1) || p.z > 1) {
+		return 1;
+	}
+	return shadow_map.SampleCmpLevelZero(shadow_sampler, uv, p.z);
+}
+
+float3 shade(float3 albedo, float3 n, float3 world, float view_z, float2 pixel) {
+	float3 light = ambient + moon_color * saturate(dot(n, moon_direction)) * moon_shadow(world, n);
+
+	uint2 tile = min(uint2(pixel / tile_size), uint2(CLUSTER_X - 1, CLUSTER_Y - 1));
+	uint slice = (uint) clamp(floor(log(view_z) * slice_scale + slice_bias), 0, CLUSTER_Z - 1);
+	uint2 list = clusters[tile.x + tile.y * CLUSTER_X + slice * CLUSTER_X * CLUSTER_Y];
+
+	for (uint i = 0; i < list.y; i++) {
+		Light l = lights[light_base + light_indices[list.x + i]];
+		float3 to_light = l.position - world;
+		float dist_sq = max(dot(to_light, to_light), 1e-4);
+		float3 dir = to_light * rsqrt(dist_sq);
+
+		// inverse square, windowed to reach zero at the range
+		float ratio = dist_sq / (l.range * l.range);
+		float window = saturate(1 - ratio * ratio);
+		float attenuation = window * window / dist_sq;
+
+		// point lights have scale 0 and offset 1
+		float spot = saturate(dot(-dir, l.direction) * l.spot_scale + l.spot_offset);
+		attenuation *= spot * spot;
+
+		light += l.color * saturate(dot(n, dir)) * attenuation;
+	}
+	return albedo * light;
+}
+#endif
 
 float4 main(Input input) : SV_Target0 {
-	return tex.Sample(smp, input.uv) * input.color;
+	float4 color = float4(1, 1, 1, 1);
+#ifdef TEXTURED
+	Material material = materials[input.material];
+	color *= tex.Sample(smp, float3(input.uv, material.layer)) * material.base_color;
+#endif
+#ifdef VERTEX_COLOR
+	color *= input.color;
+#endif
+#ifdef ALPHA_TEST
+	clip(color.a - 0.5);
+#endif
+#ifdef LIT
+	color.rgb = shade(color.rgb, normalize(input.normal), input.world, input.view_z, input.position.xy);
+#endif
+	return color;
 }
@@ -1,23 +1,110 @@
-cbuffer UBO : register(b0, space1) {
-	float4x4 mvp;
+// feature bits come from the build as -D defines, see build.ps1
+// INSTANCED: model transform and material come from the instance records,
+// looked up through a list of record indices
+// GPU_CULLED: the list of record indices is the one written by cull.comp
+// DEPTH_ONLY: position in, position out, for the depth prepass
+// LIT: passes world position, normal and view depth on for the lighting
+
+// the rows of an affine model transform, kept as float4s so the layout is
+// the same for every shader target
+struct Affine {
+	float4 rows[3];
+};
+
+cbuffer FrameUBO : register(b0, space1) {
+	float4x4 view;
+	float4x4 proj;
+	float4x4 view_proj;
+};
+
+#if defined(INSTANCED) || defined(GPU_CULLED)
+cbuffer DrawUBO : register(b1, space1) {
+	uint instance_offset;
+};
+#else
+cbuffer DrawUBO : register(b1, space1) {
+	Affine draw_model;
+	uint draw_material;
+};
+#endif
+
+#if defined(INSTANCED) || defined(GPU_CULLED)
+struct Instance {
+	Affine model;
+	float4 sphere;
+	uint draw;
+	uint material;
+	uint2 padding;
 };
 
+StructuredBuffer<Instance> instances : register(t0, space0);
+StructuredBuffer<uint> records : register(t1, space0);
+#endif
+
+float3 transform_point(Affine m, float3 p) {
+	float4 p4 = float4(p, 1);
+	return float3(dot(m.rows[0], p4), dot(m.rows[1], p4), dot(m.rows[2], p4));
+}
+
+// model transforms are rigid, no inverse transpose needed
+float3 transform_normal(Affine m, float3 n) {
+	return float3(dot(m.rows[0].xyz, n), dot(m.rows[1].xyz, n), dot(m.rows[2].xyz, n));
+}
+
+#if defined(LIT) && !defined(DEPTH_ONLY)
+#define SHADE_LIT
+#endif
+
 struct Input {
 	float3 position : TEXCOORD0;
+#ifndef DEPTH_ONLY
 	float4 color : TEXCOORD1;
 	float2 uv : TEXCOORD2;
+#endif
+#ifdef SHADE_LIT
+	float3 normal : TEXCOORD3;
+#endif
 };
 
 struct Output {
 	float4 position : SV_Position;
+#ifndef DEPTH_ONLY
 	float4 color : TEXCOORD0;
 	float2 uv : TEXCOORD1;
+#endif
+#ifdef SHADE_LIT
+	float3 normal : TEXCOORD2;
+	float3 world : TEXCOORD3;
+	float view_z : TEXCOORD4;
+#endif
+#ifndef DEPTH_ONLY
+	nointerpolation uint material : TEXCOORD5;
+#endif
 };
 
-Output main(Input input) {
+Output main(Input input, uint instance_id : SV_InstanceID) {
 	Output output;
-	output.position = mul(mvp, float4(input.position, 1));
+	// precise: the prepass and the EQUAL color pass must agree bit for bit
+#if defined(INSTANCED) || defined(GPU_CULLED)
+	Instance instance = instances[records[instance_offset + instance_id]];
+	Affine model = instance.model;
+	uint material = instance.material;
+#else
+	Affine model = draw_model;
+	uint material = draw_material;
+#endif
+	precise float3 world = transform_point(model, input.position);
+	precise float4 position = mul(view_proj, float4(world, 1));
+	output.position = position;
+#ifndef DEPTH_ONLY
 	output.color = input.color;
 	output.uv = input.uv;
+	output.material = material;
+#endif
+#ifdef SHADE_LIT
+	output.normal = transform_normal(model, input.normal);
+	output.world = world;
+	output.view_z = mul(view, float4(world, 1)).z;
+#endif
 	return output;
 }
@@ -3,16 +3,45 @@ Set-Location $PSScriptRoot
 $shadercross  = "tools/shadercross.exe"
 $shaderSrcDir = "assets/shaders/src"
 $shaderOutDir = "assets/shaders/out"
-$formats = @("spv", "dxil", "json")
+$formats = @("spv", "dxil", "msl", "json")
+
+# Feature bits, keep in sync with ShaderFeature in src/shader.h.
+# Shaders listed in $permutations are compiled once per subset of their
+# features to <name>.<mask as 2 hex digits>.<stage>.<format>.
+$featureBits = @{ TEXTURED = 1; VERTEX_COLOR = 2; INSTANCED = 4; ALPHA_TEST = 8; GPU_CULLED = 16; DEPTH_ONLY = 32; LIT = 64 }
+$permutations = @{
+    "shader.vert" = @("INSTANCED", "GPU_CULLED", "DEPTH_ONLY", "LIT")
+    "shader.frag" = @("TEXTURED", "VERTEX_COLOR", "ALPHA_TEST", "LIT")
+}
 
 Get-ChildItem $shaderSrcDir -File | ForEach-Object {
     $basename = $_.BaseName
-    foreach ($format in $formats) {
-        $outFile = "$shaderOutDir/$basename.$format"
-        & $shadercross $_.FullName -o $outFile
-        if ($LASTEXITCODE -ne 0) {
-            Write-Host "> ಠ_ಠ failed: $($_.Name) → $format"
-            exit 1
+    $features = @()
+    if ($permutations.ContainsKey($basename)) { $features = $permutations[$basename] }
+
+    for ($subset = 0; $subset -lt (1 -shl $features.Count); $subset++) {
+        $mask = 0
+        $defines = @()
+        for ($i = 0; $i -lt $features.Count; $i++) {
+            if ($subset -band (1 -shl $i)) {
+                $mask = $mask -bor $featureBits[$features[$i]]
+                $defines += "-D$($features[$i])"
+            }
+        }
+
+        $outName = $basename
+        if ($features.Count -gt 0) {
+            $name, $stage = $basename.Split(".", 2)
+            $outName = "{0}.{1:x2}.{2}" -f $name, $mask, $stage
+        }
+
+        foreach ($format in $formats) {
+            $outFile = "$shaderOutDir/$outName.$format"
+            & $shadercross $_.FullName -o $outFile @defines
+            if ($LASTEXITCODE -ne 0) {
+                Write-Host "> ಠ_ಠ failed: $($_.Name) [$($defines -join ' ')] → $format"
+                exit 1
+            }
         }
     }
 }
@@ -23,4 +52,10 @@ if ($LASTEXITCODE -ne 0) {
     exit 1
 }
 
+& "$PSScriptRoot/build/bin/shaderpack.exe" $shaderOutDir "assets/shaders/shaders.pack"
+if ($LASTEXITCODE -ne 0) {
+    Write-Host "> ಠ_ಠ shader pack failed"
+    exit 1
+}
+
 & "$PSScriptRoot/build/bin/app.exe"
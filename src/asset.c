@@ -4,7 +4,10 @@
 #include "lib/fast_obj.h"
 #include "lib/stb_image.h"
 
-SDL_GPUTexture *load_texture_file(SDL_GPUDevice *gpu, SDL_GPUCopyPass *copy_pass, const char *texturefile)
+// Loads an image into one layer of an array texture, resampled to the
+// layer size with nearest filtering so palette textures stay crisp.
+bool load_texture_layer(SDL_GPUDevice *gpu, SDL_GPUCopyPass *copy_pass, SDL_GPUTexture *texture,
+                        Uint32 layer, Uint32 size, const char *texturefile)
 {
     int raw_width, raw_height;
     char tex_filepath[256];
@@ -13,29 +16,40 @@ SDL_GPUTexture *load_texture_file(SDL_GPUDevice *gpu, SDL_GPUCopyPass *copy_pass
     stbi_set_flip_vertically_on_load(1);
     Uint8 *pixels = stbi_load(tex_filepath, &raw_width, &raw_height, NULL, 4);
     if (!pixels) {
-        SDL_Log("Failed to load texture image\n%s", stbi_failure_reason());
-        SDL_Quit();
+        SDL_Log("Failed to load texture image %s\n%s", texturefile, stbi_failure_reason());
+        return false;
     }
 
-    Uint32 img_width = (Uint32) raw_width;
-    Uint32 img_height = (Uint32) raw_height;
-    Uint32 pixels_byte_size = img_width * img_height * 4;
-
-    SDL_GPUTexture *texture = upload_texture(gpu, copy_pass, pixels, pixels_byte_size, img_width, img_height);
+    Uint32 *resampled = SDL_malloc((size_t) size * size * 4);
+    if (!resampled) {
+        SDL_Log("Failed to allocate %ux%u texture layer", size, size);
+        stbi_image_free(pixels);
+        return false;
+    }
+    const Uint32 *src = (const Uint32 *) pixels;
+    for (Uint32 y = 0; y < size; y++) {
+        Uint32 src_y = (Uint32) ((Uint64) y * (Uint32) raw_height / size);
+        for (Uint32 x = 0; x < size; x++) {
+            Uint32 src_x = (Uint32) ((Uint64) x * (Uint32) raw_width / size);
+            resampled[y * size + x] = src[src_y * (Uint32) raw_width + src_x];
+        }
+    }
     stbi_image_free(pixels);
 
-    return texture;
+    upload_texture_layer(gpu, copy_pass, texture, layer, resampled, size * size * 4, size, size, texturefile);
+    SDL_free(resampled);
+    return true;
 }
 
-Mesh load_obj_file(SDL_GPUDevice *gpu, SDL_GPUCopyPass *copy_pass, const char *meshfile)
+bool load_obj_file(SDL_GPUDevice *gpu, SDL_GPUCopyPass *copy_pass, const char *meshfile, Mesh *mesh_out)
 {
     char mesh_filepath[256];
     SDL_snprintf(mesh_filepath, sizeof(mesh_filepath), "assets/meshes/%s", meshfile);
 
     fastObjMesh *obj_data = fast_obj_read(mesh_filepath);
     if (!obj_data) {
-        SDL_Log("Failed to load OBJ file\n%s", SDL_GetError());
-        SDL_Quit();
+        SDL_Log("Failed to load OBJ file %s", meshfile);
+        return false;
     }
 
     Vertex *vertices = SDL_malloc(obj_data->index_count * sizeof *vertices);
@@ -47,7 +61,7 @@ Mesh load_obj_file(SDL_GPUDevice *gpu, SDL_GPUCopyPass *copy_pass, const char *m
         SDL_free(indices);
 
         SDL_Log("Failed to allocate vertices/indices");
-        SDL_Quit();
+        return false;
     }
 
     for (size_t i = 0; i < obj_data->index_count; ++i) {
@@ -66,27 +80,70 @@ Mesh load_obj_file(SDL_GPUDevice *gpu, SDL_GPUCopyPass *copy_pass, const char *m
             vertices[i].uv[1] = 0.0f;
         }
 
+        if (idx.n != 0) {
+            float *normals = &obj_data->normals[3 * idx.n];
+            SDL_memcpy(vertices[i].normal, normals, sizeof(vec3));
+        } else {
+            vec3_copy(YUP, vertices[i].normal);
+        }
+
         indices[i] = (uint16_t)i;
     }
 
+    // corners without a normal get the face normal of their triangle
+    for (size_t i = 0; i + 2 < obj_data->index_count; i += 3) {
+        if (obj_data->indices[i].n != 0 && obj_data->indices[i + 1].n != 0 && obj_data->indices[i + 2].n != 0) continue;
+
+        vec3 e1, e2, n;
+        vec3_sub(vertices[i + 1].pos, vertices[i].pos, e1);
+        vec3_sub(vertices[i + 2].pos, vertices[i].pos, e2);
+        vec3_crossn(e1, e2, n);
+        for (int k = 0; k < 3; k++) {
+            if (obj_data->indices[i + k].n == 0) vec3_copy(n, vertices[i + k].normal);
+        }
+    }
+
+    Uint32 index_count = obj_data->index_count;
     fast_obj_destroy(obj_data);
 
     Mesh mesh = upload_mesh_bytes(gpu, copy_pass,
-    vertices, obj_data->index_count * sizeof(Vertex),
-    indices, obj_data->index_count * sizeof(uint16_t),
-    obj_data->index_count);
+    vertices, index_count * sizeof(Vertex),
+    indices, index_count * sizeof(uint16_t),
+    index_count, meshfile);
+
+    // bounding sphere around the aabb center, good enough for culling
+    vec3 lo = VEC3_ZERO_INIT, hi = VEC3_ZERO_INIT;
+    if (index_count > 0) {
+        vec3_copy(vertices[0].pos, lo);
+        vec3_copy(vertices[0].pos, hi);
+    }
+    for (Uint32 i = 1; i < index_count; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            lo[axis] = SDL_min(lo[axis], vertices[i].pos[axis]);
+            hi[axis] = SDL_max(hi[axis], vertices[i].pos[axis]);
+        }
+    }
+    vec3_add(lo, hi, mesh.center);
+    vec3_scale(mesh.center, 0.5f, mesh.center);
+    for (Uint32 i = 0; i < index_count; i++) {
+        vec3 offset;
+        vec3_sub(vertices[i].pos, mesh.center, offset);
+        mesh.radius = SDL_max(mesh.radius, vec3_norm(offset));
+    }
 
     SDL_free(indices);
     SDL_free(vertices);
-    return mesh;
+    *mesh_out = mesh;
+    return true;
 }
 
-Model load_model(AppState *app, SDL_GPUCopyPass *copy_pass, const char *meshfile, const char *texturefile)
+Model load_model(AppState *app, SDL_GPUCopyPass *copy_pass, const char *meshfile)
 {
     Model model = {0};
 
-    model.texture = load_texture_file(app->gpu, copy_pass, texturefile);
-    model.mesh    = load_obj_file(app->gpu, copy_pass, meshfile);
+    if (!load_obj_file(app->gpu, copy_pass, meshfile, &model.mesh)) {
+        SDL_Log("Failed to load model %s", meshfile);
+    }
 
     return model;
 }
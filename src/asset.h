@@ -3,7 +3,8 @@
 #include <SDL3/SDL.h>
 #include "common.h"
 
-SDL_GPUTexture *load_texture_file(SDL_GPUDevice *gpu, SDL_GPUCopyPass *copy_pass, const char *texturefile);
-Mesh load_obj_file(SDL_GPUDevice *gpu, SDL_GPUCopyPass *copy_pass, const char *meshfile);
-Model load_model(AppState *app, SDL_GPUCopyPass *copy_pass, const char *meshfile, const char *texturefile);
+bool load_texture_layer(SDL_GPUDevice *gpu, SDL_GPUCopyPass *copy_pass, SDL_GPUTexture *texture,
+                        Uint32 layer, Uint32 size, const char *texturefile);
+bool load_obj_file(SDL_GPUDevice *gpu, SDL_GPUCopyPass *copy_pass, const char *meshfile, Mesh *mesh);
+Model load_model(AppState *app, SDL_GPUCopyPass *copy_pass, const char *meshfile);
 
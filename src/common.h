@@ -2,9 +2,68 @@
 
 #include <SDL3/SDL.h>
 #include "lib/linalg.h"
+#include "shader.h"
+#include "jobs.h"
 
 #define MAX_MODELS 4
-#define MAX_ENTITIES 8
+
+#define TRANSIENT_BUFFER_SIZE (4 * 1024 * 1024)
+
+#define GPU_MEM_BUDGET ((Uint64) 512 * 1024 * 1024)
+#define GPU_MEM_REPORT_TOP 8
+
+#define PIPELINE_CACHE_SIZE 64
+
+// frames the cpu may run ahead of the gpu, APP_FRAMES_IN_FLIGHT overrides
+#define FRAMES_IN_FLIGHT_DEFAULT 2
+#define FRAMES_IN_FLIGHT_MAX 3
+
+// dynamic resolution: the scene renders into the top-left corner of the
+// full size targets, scaled per axis by a factor in this range
+#define RES_SCALE_MIN 0.5f
+#define RES_SCALE_MAX 1.0f
+#define GPU_TIMING_SLOTS (FRAMES_IN_FLIGHT_MAX + 1)
+
+// frame limiter sleeps until this long before the deadline, then spins
+#define FRAME_LIMITER_SPIN_NS (2 * SDL_NS_PER_MS)
+
+// below this many items per slice a draw list is recorded on one thread
+#define RECORD_SLICE_MIN_ITEMS 256
+#define RECORD_MAX_SLICES (MAX_WORKERS + 1)
+
+// render graph capacity per frame
+#define RENDER_GRAPH_MAX_PASSES 16
+#define RENDER_GRAPH_MAX_RESOURCES 16
+#define RENDER_GRAPH_MAX_ACCESSES 6
+#define RENDER_GRAPH_MAX_TEXTURES 16
+
+// render target pool: targets come back once the frame that used them is
+// done on the gpu and are released after going unused for a while. Sizes
+// are rounded up to the step, so resizing in small steps reuses targets.
+#define RT_POOL_MAX_TARGETS 32
+#define RT_POOL_MAX_FRAMES 8
+#define RT_POOL_RETIRE_FRAMES 120
+#define RT_POOL_SIZE_STEP 128
+
+// clustered lighting: screen tiles times exponential depth slices, must
+// match the shaders. The index list holds this many lights per cluster on
+// average, clusters past its end drop lights.
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+#define CLUSTER_AVERAGE_LIGHTS 32
+#define LIGHT_COUNT_DEFAULT 256
+
+// material textures are layers of one array, resampled to this size
+#define MATERIAL_TEXTURE_SIZE 512
+#define MATERIAL_MAX_LAYERS 16
+#define MATERIAL_FILE_LEN 64
+
+// moon shadow: one orthographic map over a fixed area around the origin
+#define SHADOW_MAP_SIZE 2048
+#define SHADOW_EXTENT 25.0f         // half width of the covered area
+#define SHADOW_DISTANCE 50.0f       // light camera distance from the origin
 
 // linear colors
 #define WHITE_COLOR ((SDL_FColor){ 1, 1, 1, 1 })
@@ -16,6 +75,14 @@ typedef struct {
     float delta_time;
 } TimeState;
 
+typedef struct {
+    SDL_GPUPresentMode present_mode;
+    Uint32 fps_limit;           // 0 for none
+    Uint64 frame_deadline_ns;
+    Uint64 latched_event_ns;    // input event the frame being rendered saw
+    float input_latency_ms;     // input event to submit, smoothed
+} FramePacing;
+
 typedef struct {
     vec3 position;
     vec3 target;
@@ -26,42 +93,590 @@ typedef struct {
     float pitch;
 } Look;
 
+typedef struct {
+    bool key_down[SDL_SCANCODE_COUNT];
+    vec2 mouse_move;        // accumulated since the last latch
+    Uint64 event_ns;        // newest event since the last latch, 0 for none
+    bool traffic;           // F9, see Traffic
+} InputState;
+
 typedef struct {
     SDL_GPUBuffer *vertex_buffer;
     SDL_GPUBuffer *index_buffer;
     Uint32 index_count;
+    vec3 center;            // local bounding sphere
+    float radius;
 } Mesh;
 
 typedef struct {
     Mesh mesh;
-    SDL_GPUTexture *texture;
 } Model;
 
 typedef int Model_ID;
 
+// per-frame linear allocator: a cycled transfer buffer that is uploaded in
+// one go into a cycled storage buffer, so the gpu never waits on last frame
+typedef struct {
+    SDL_GPUTransferBuffer *transfer_buffer;
+    SDL_GPUBuffer *buffer;
+    SDL_GPUBufferUsageFlags usage;
+    Uint32 capacity;
+    Uint32 offset;
+    Uint32 wanted;
+    Uint8 *mapped;
+} TransientBuffer;
+
+typedef enum {
+    ENTITY_STATIC = 1 << 0,     // never moves, cached in the shadow map
+} EntityFlags;
+
+// Names an entity across spawns and despawns. The slot's generation moves
+// on when the entity is despawned, which makes old handles stale.
+typedef struct {
+    Uint32 slot;
+    Uint32 generation;          // 0 is never live
+} EntityHandle;
+
+#define ENTITY_NONE ((EntityHandle) { 0, 0 })
+
+// one entity's components, to spawn from
 typedef struct {
     Model_ID model_id;
-    vec3 position;
-    quat rotation;
+    vec3 position;              // relative to the parent
+    quat rotation;              // relative to the parent
+    Uint32 material;            // index into the material table
+    Uint32 flags;               // EntityFlags, static entities need static parents
+    EntityHandle parent;        // ENTITY_NONE for roots
 } Entity;
 
+// Entities in struct-of-arrays form: every component is its own array
+// indexed by entity, so a loop over one component streams just that.
+// The dense arrays have no holes, despawning moves the last entity into
+// the gap. Handles go through a slot table whose free slots form a list.
+// Parents are kept ahead of their children. Each slot links to its first
+// child and its siblings, so a despawn finds the children without a scan,
+// and the transform update walks down from the entities that moved, which
+// are queued by slot. Grows on demand.
+typedef struct {
+    vec3 *position;
+    quat *rotation;
+    Model_ID *model_id;
+    Uint32 *material;
+    Uint32 *flags;
+    Uint32 *slot;               // dense index to slot
+    Uint32 *parent;             // slot of the parent, ENTITY_SLOT_NONE for roots
+    mat3x4 *world;              // valid after entity_update_transforms
+    int count;
+    int capacity;
+    int changed_first;          // dense range written since the changes were last taken,
+    int changed_end;            // empty when first >= end, see entity_store_copy
+
+    Uint32 *slot_dense;         // slot to dense index, next free slot when free
+    Uint32 *slot_generation;
+    Uint32 *first_child;        // per slot, ENTITY_SLOT_NONE for leaves
+    Uint32 *next_sibling;       // per slot, doubly linked among the parent's children
+    Uint32 *prev_sibling;
+    Uint8 *dirty;               // per slot, position or rotation changed, see entity_moved
+    Uint32 *dirty_slots;        // the dirty slots, some may have been freed since
+    int dirty_count;
+    int slot_count;
+    int slot_capacity;
+    Uint32 free_slot;           // ENTITY_SLOT_NONE when empty
+
+    Uint32 model_count[MAX_MODELS];  // entities per model
+
+    Uint32 version;             // bumped by every spawn and despawn
+    Uint32 static_version;      // bumped when a static entity comes or goes
+} EntityStore;
+
+#define ENTITY_SLOT_NONE 0xFFFFFFFFu
+
+#define TRAFFIC_MAX 16
+
+// Demo traffic: carts with a stack of crates riding on them drive down a
+// lane, spawned at one end and despawned with their riders at the other
+typedef struct {
+    EntityHandle carts[TRAFFIC_MAX];    // ring, oldest at first
+    int first;
+    int count;
+    float spawn_timer;
+    Uint32 cart_material[2];
+    Uint32 rider_material;
+} Traffic;
+
+// Simulation runs one frame ahead on its own thread: while frame N is
+// recorded from the snapshot, update N+1 writes the live state in AppState.
+typedef struct {
+    Camera camera;
+    Look look;
+    EntityStore entities;
+} RenderSnapshot;
+
+typedef struct {
+    SDL_Thread *thread;
+    SDL_Semaphore *go;
+    SDL_Semaphore *done;
+    bool busy;
+    bool quit;
+} SimThread;
+
+typedef enum {
+    VERTEX_LAYOUT_MESH,
+    VERTEX_LAYOUT_POSITION,
+    VERTEX_LAYOUT_COUNT
+} VertexLayout;
+
+// Everything that goes into an SDL_GPUGraphicsPipelineCreateInfo, without
+// pointers and without padding so it can be hashed and compared as bytes.
+typedef struct {
+    char vertex_shader[SHADER_NAME_LEN];
+    char fragment_shader[SHADER_NAME_LEN];
+    Uint32 vertex_layout;       // VertexLayout
+    Uint32 primitive_type;      // SDL_GPUPrimitiveType
+    Uint32 fill_mode;           // SDL_GPUFillMode
+    Uint32 cull_mode;           // SDL_GPUCullMode
+    Uint32 depth_compare;       // SDL_GPUCompareOp
+    Uint32 depth_test;
+    Uint32 depth_write;
+    Uint32 num_color_targets;
+    Uint32 color_format;        // SDL_GPUTextureFormat
+    Uint32 depth_format;        // SDL_GPUTextureFormat, INVALID for none
+    float depth_bias_constant;  // both 0 for no bias
+    float depth_bias_slope;
+} PipelineDesc;
+
+typedef struct {
+    Uint64 hash;
+    PipelineDesc desc;
+    SDL_GPUGraphicsPipeline *pipeline;
+} PipelineCacheEntry;
+
+typedef struct {
+    PipelineCacheEntry entries[PIPELINE_CACHE_SIZE];
+    int count;
+    SDL_Mutex *lock;
+} PipelineCache;
+
+// 64-bit draw sort key, most significant first. Materials are per instance
+// and don't break batches, so they are not part of the state.
+//   DRAW_ORDER_STATE:         pass:4 | pipeline:8 | mesh:12 | depth:24 | unused:16
+//   DRAW_ORDER_FRONT_TO_BACK: pass:4 | depth:24 | pipeline:8 | mesh:12 | unused:16
+#define DRAW_KEY_PASS_SHIFT     60
+#define DRAW_KEY_PIPELINE_SHIFT 52
+#define DRAW_KEY_MESH_SHIFT     40
+#define DRAW_KEY_DEPTH_SHIFT    16
+#define DRAW_KEY_DEPTH_BITS     24
+#define DRAW_KEY_STATE_BITS     20
+
+typedef enum {
+    DRAW_ORDER_STATE,           // fewest binds, depth only breaks ties
+    DRAW_ORDER_FRONT_TO_BACK,   // least overdraw, state only breaks ties
+    DRAW_ORDER_COUNT
+} DrawOrder;
+
+typedef enum {
+    DRAW_PASS_OPAQUE,
+} DrawPass;
+
+typedef struct {
+    SDL_GPUGraphicsPipeline *pipeline;
+    const Mesh *mesh;
+    Uint32 instance;        // caller data, e.g. the entity index
+} DrawItem;
+
+typedef struct {
+    Uint32 draws;
+    Uint32 items;
+    Uint32 binds;
+    Uint32 binds_skipped;
+} DrawStats;
+
+typedef struct {
+    DrawItem *items;
+    Uint64 *keys;
+    Uint32 *order;          // sorted position -> item index
+    Uint64 *scratch_keys;
+    Uint32 *scratch_order;
+    int count;
+    int capacity;
+    DrawStats stats;
+} DrawList;
+
+typedef struct {
+    SDL_GPUFence *fence;
+    Uint64 submit_ns;
+} GPUTimingSlot;
+
+// Resolution controller: keeps max(cpu, gpu) frame time under the budget
+// by scaling the scene targets' render area. GPU time comes from polling
+// submit fences once per frame, an upper bound at frame granularity.
+typedef struct {
+    bool enabled;
+    float scale;
+    float budget_ms;
+    float cpu_ms;               // smoothed
+    float gpu_ms;               // smoothed
+    Uint32 width;               // render area this frame
+    Uint32 height;
+    Uint64 frame_start_ns;
+    Uint64 last_done_ns;
+    GPUTimingSlot slots[GPU_TIMING_SLOTS];
+    int head;
+    int count;
+} DynamicResolution;
+
+// Parallel recording: slices of the sorted draw list are recorded on the
+// job pool, each into its own command buffer, and submitted in list order.
+typedef struct {
+    SDL_Mutex *lock;
+    SDL_Condition *submitted;
+    int next_submit;
+    DrawStats stats[RECORD_MAX_SLICES];
+} RecordQueue;
+
+// what every slice renders into: the first slice loads with the load ops,
+// the last stores with the store ops, the ones between load and store
+typedef struct {
+    SDL_GPUTexture *color_texture;
+    SDL_GPUTexture *depth_texture;
+    SDL_GPULoadOp color_load_op;
+    SDL_GPUStoreOp color_store_op;
+    SDL_GPULoadOp depth_load_op;
+    SDL_GPUStoreOp depth_store_op;
+    Uint32 width;               // render area
+    Uint32 height;
+    SDL_FColor clear_color;
+    const void *uniforms;       // vertex slot 0
+    Uint32 uniforms_size;
+    Uint32 instance_offset;
+} RecordTarget;
+
+// world-space bounding spheres in SoA form for the simd frustum test
 typedef struct {
+    float *x;
+    float *y;
+    float *z;
+    float *r;
+    Uint32 *visible;
+    int capacity;
+} CullBuffers;
+
+typedef struct {
+    Uint32 tested;
+    Uint32 visible;
+    Uint32 culled;
+} CullStats;
+
+typedef struct {
+    Uint32 full_uploads;
+    Uint32 uploaded;            // instance records copied this frame
+} InstanceStats;
+
+// Instance records of every entity in one persistent buffer, read by both
+// render paths through lists of record indices. A record sits at its
+// entity's dense index in the snapshot, and only the range the snapshot
+// changed since the last upload is written again, so entities that stay
+// put, static or not, are uploaded once.
+typedef struct {
+    SDL_GPUBuffer *buffer;
+    Uint32 capacity;
+    Uint32 count;
+    bool valid;                 // buffer holds every record as of the last upload
+
+    // this frame's records inside frame_data, copied into buffer from
+    // upload_first on by instances_upload
+    bool upload_full;
+    Uint32 upload_offset;
+    Uint32 upload_first;
+    Uint32 upload_count;
+    InstanceStats stats;
+} InstanceBuffer;
+
+// GPU-driven path: cull.comp culls the persistent instance records and
+// writes indexed indirect commands per model plus the compacted list of
+// visible record indices. Two phases per frame: early redraws what was
+// visible last frame, late tests the rest against a depth pyramid (Hi-Z)
+// built from the early depth, so disoccluded objects show up the same frame.
+typedef enum {
+    GPU_CULL_EARLY,
+    GPU_CULL_LATE,
+    GPU_CULL_PHASE_COUNT
+} GPUCullPhase;
+
+typedef struct {
+    SDL_GPUComputePipeline *cull_pipeline;
+    SDL_GPUGraphicsPipeline *pipeline;
+    SDL_GPUBuffer *draw_buffer;         // GPU_CULL_PHASE_COUNT * MAX_MODELS commands
+    SDL_GPUBuffer *visible_buffer;      // one list per phase
+    SDL_GPUBuffer *visibility_buffer;   // per instance, kept across frames
+    Uint32 visible_capacity;
+    bool history;                       // visibility_buffer is from last frame
+    Uint32 entity_version;              // EntityStore.version the history is for
+
+    // depth pyramid, farthest depth per texel, mip 0 at half resolution
+    SDL_GPUComputePipeline *hiz_pipeline;
+    SDL_GPUTexture *hiz_texture;
+    SDL_GPUTexture *hiz_scratch;
+    SDL_GPUSampler *hiz_sampler;
+    Uint32 hiz_width;
+    Uint32 hiz_height;
+    Uint32 hiz_levels;
+
+    // this frame's layout inside frame_data
+    Uint32 draw_first_base;
+    Uint32 commands_offset;
+    Uint32 draw_first[MAX_MODELS];
+    Uint32 draw_count[MAX_MODELS];
+} GPUCull;
+
+typedef struct {
+    EntityHandle entity;        // attached to this entity, ENTITY_NONE for none
+    vec3 position;              // entity local when attached
+    vec3 direction;             // spot axis, entity local when attached
+    vec3 color;                 // linear, times intensity
+    float range;
+    bool spot;
+    float cos_inner;            // spot cone, full within inner, none past outer
+    float cos_outer;
+} Light;
+
+// Clustered forward lighting: light_cluster.comp assigns the lights written
+// into frame_data to the clusters of the view frustum, the LIT fragment
+// shader then only loops over the lights of its own cluster.
+typedef struct {
+    Light *lights;
+    int count;
+    int capacity;
+
+    SDL_GPUComputePipeline *cluster_pipeline;
+    SDL_GPUBuffer *cluster_buffer;      // offset and count per cluster
+    SDL_GPUBuffer *index_buffer;        // the lists, CLUSTER_AVERAGE_LIGHTS per cluster
+    SDL_GPUBuffer *counter_buffer;
+
+    // this frame's layout inside frame_data
+    Uint32 light_base;
+    Uint32 light_count;
+    Uint32 counter_offset;
+} LightSystem;
+
+typedef struct {
+    vec4 base_color;            // linear, times the texture
+    Uint32 layer;               // in MaterialTable.textures
+} Material;
+
+// Material table: parameters of every material in one storage buffer, the
+// textures as layers of one array. Instances carry a material index, so
+// draws with different materials share the pipeline and the bindings.
+typedef struct {
+    SDL_GPUTexture *textures;   // 2d array of MATERIAL_TEXTURE_SIZE squares
+    char layer_files[MATERIAL_MAX_LAYERS][MATERIAL_FILE_LEN];
+    Uint32 layer_count;
+
+    Material *materials;
+    int count;
+    int capacity;
+    SDL_GPUBuffer *buffer;
+    int buffer_capacity;
+    bool dirty;                 // materials changed since the last upload
+} MaterialTable;
+
+typedef struct {
+    Uint32 rebuilds;            // since start
+    Uint32 static_casters;      // in the cache
+    Uint32 dynamic_casters;     // this frame
+} ShadowStats;
+
+// Cached shadow map: static casters are rendered into a persistent map only
+// when the light or the static entities change. Every frame that map is
+// copied into a pooled one and the dynamic casters are drawn on top, so the
+// per-frame cost follows what moves.
+typedef struct {
+    SDL_GPUGraphicsPipeline *pipeline;  // depth only, biased
+    SDL_GPUTexture *static_texture;     // static casters, kept across frames
+    SDL_GPUSampler *sampler;            // depth compare
+    SDL_GPUTexture *texture;            // this frame's map, set by the graph
+    mat4 view_proj;
+
+    // what the cache holds
+    bool valid;
+    vec3 direction;
+    Uint32 static_version;
+    bool rebuild;                       // this frame re-renders the cache
+
+    // this frame's record index lists inside frame_data, per model
+    Uint32 static_first[MAX_MODELS];
+    Uint32 static_count[MAX_MODELS];
+    Uint32 dynamic_first[MAX_MODELS];
+    Uint32 dynamic_count[MAX_MODELS];
+    ShadowStats stats;
+} ShadowCache;
+
+// the pool key, compared as bytes
+typedef struct {
+    SDL_GPUTextureFormat format;
+    SDL_GPUTextureUsageFlags usage;
+    Uint32 width;
+    Uint32 height;
+    Uint32 num_levels;
+    SDL_GPUSampleCount sample_count;
+} RenderTargetDesc;
+
+typedef struct {
+    RenderTargetDesc desc;
+    SDL_GPUTexture *texture;
+    Uint64 last_frame;          // serial of the last frame that used it
+} RenderTarget;
+
+typedef struct {
+    SDL_GPUFence *fence;        // NULL when the submit gave none
+    Uint64 frame;
+} RenderTargetFence;
+
+typedef struct {
+    Uint32 targets;
+    Uint32 created;             // since start
+    Uint32 released;
+} RenderTargetPoolStats;
+
+typedef struct {
+    RenderTarget targets[RT_POOL_MAX_TARGETS];
+    int count;
+    RenderTargetFence fences[RT_POOL_MAX_FRAMES];   // frames in flight, oldest first
+    int fence_count;
+    Uint64 frame;               // serial of the frame being recorded
+    Uint64 completed;           // every frame up to here is done on the gpu
+    RenderTargetPoolStats stats;
+} RenderTargetPool;
+
+// Render graph: passes declare the textures they touch, the graph drops
+// passes nothing depends on, backs transient textures with pooled ones
+// shared between resources whose lifetimes don't overlap, and picks every
+// attachment's load and store op from what the passes around it do.
+typedef enum {
+    GRAPH_PASS_RENDER,      // the graph begins a render pass on its attachments
+    GRAPH_PASS_CUSTOM,      // records its own compute, copy or render passes
+} GraphPassType;
+
+typedef enum {
+    GRAPH_ACCESS_READ,      // sampled, copied from or read as storage
+    GRAPH_ACCESS_WRITE,     // overwritten as a whole outside a render pass
+    GRAPH_ACCESS_COLOR,     // color attachment
+    GRAPH_ACCESS_DEPTH,     // depth attachment
+} GraphAccessType;
+
+typedef struct {
+    GraphAccessType type;
+    int resource;
+    bool clear;             // attachments: clear, discarding what came before
+    SDL_FColor clear_color;
+} GraphAccess;
+
+typedef struct RenderGraph RenderGraph;
+typedef struct AppState AppState;
+
+typedef struct {
+    AppState *app;
+    RenderGraph *graph;
+    int pass;
+    SDL_GPUCommandBuffer *cmd_buf;      // custom passes may submit and replace it
+    SDL_GPURenderPass *render_pass;     // NULL for custom passes
+} GraphContext;
+
+typedef void (*GraphExecuteFunc)(GraphContext *ctx, void *userdata);
+
+typedef struct {
+    const char *name;
+    GraphPassType type;
+    GraphAccess accesses[RENDER_GRAPH_MAX_ACCESSES];
+    int access_count;
+    GraphExecuteFunc execute;
+    void *userdata;
+    bool keep;              // has effects the graph can't see, never culled
+    bool live;
+} GraphPass;
+
+typedef struct {
+    const char *name;
+    RenderTargetDesc desc;
+    SDL_GPUTexture *texture;    // imported, or the pooled one after compile
+    bool imported;
+    bool exported;              // contents are used after the graph
+    int first_pass;             // live passes touching it, -1 for none
+    int last_pass;
+    int physical;               // index into RenderGraph.textures
+} GraphResource;
+
+// a pool target backing one or more transient resources this frame
+typedef struct {
+    RenderTargetDesc desc;
+    SDL_GPUTexture *texture;
+    int last_pass;
+} GraphTexture;
+
+typedef struct {
+    Uint32 passes;
+    Uint32 culled;
+    Uint32 transient;
+    Uint32 aliased;             // transient resources sharing a texture
+    Uint32 textures;
+} GraphStats;
+
+struct RenderGraph {
+    GraphPass passes[RENDER_GRAPH_MAX_PASSES];
+    int pass_count;
+    GraphResource resources[RENDER_GRAPH_MAX_RESOURCES];
+    int resource_count;
+    GraphTexture textures[RENDER_GRAPH_MAX_TEXTURES];
+    int texture_count;
+    GraphStats stats;
+};
+
+struct AppState {
     TimeState time;
+    JobPool jobs;
 
     SDL_GPUDevice *gpu;
     SDL_Window *window;
     Uint32 window_width;
     Uint32 window_height;
-    SDL_GPUTexture *depth_texture;
+    Uint32 swapchain_width;
+    Uint32 swapchain_height;
     SDL_GPUTextureFormat depth_texture_format;
     SDL_GPUTextureFormat swapchain_texture_format;
     
+    RenderGraph graph;
+    RenderTargetPool targets;
+
+    ShaderPack shader_pack;
+    PipelineCache pipelines;
     SDL_GPUGraphicsPipeline *pipeline;
+    SDL_GPUGraphicsPipeline *prepass_pipeline;     // position only, no color target
+    SDL_GPUGraphicsPipeline *equal_pipeline;       // color after the prepass
     SDL_GPUSampler *sampler;
+    MaterialTable materials;
+
+    TransientBuffer frame_data;
+    DrawList draw_list;
+    DrawOrder draw_order;
+    bool depth_prepass;
+    RecordQueue record;
+    bool parallel_recording;
+    CullBuffers cull;
+    CullStats cull_stats;
+    InstanceBuffer instances;
+    GPUCull gpu_cull;
+    bool gpu_culling;
+    LightSystem lights;
+    ShadowCache shadow;
+
+    InputState input;           // written by events
+    InputState sim_input;       // latched for the update in flight
+    SimThread sim;
+    RenderSnapshot snapshot;
+    Uint32 frames_in_flight;
+    FramePacing pacing;
+    DynamicResolution dynres;
 
-    bool key_down[SDL_SCANCODE_COUNT];
-    vec2 mouse_move;
-    
     Camera camera;
     Look look;
 
@@ -70,8 +685,9 @@ typedef struct {
 
     Model models[MAX_MODELS];
     int model_count;
-    Entity entities[MAX_ENTITIES];
-    int entity_count;
+    EntityStore entities;
+    EntityHandle crate;         // spun by game_update
+    Traffic traffic;
 
-} AppState;
+};
 
@@ -0,0 +1,123 @@
+#include "cull.h"
+
+bool cull_buffers_reserve(CullBuffers *buffers, int count)
+{
+    if (count <= buffers->capacity) return true;
+
+    int capacity = SDL_max(buffers->capacity, 256);
+    while (capacity < count) capacity *= 2;
+
+    float *x = SDL_realloc(buffers->x, capacity * sizeof(float));
+    if (x) buffers->x = x;
+    float *y = SDL_realloc(buffers->y, capacity * sizeof(float));
+    if (y) buffers->y = y;
+    float *z = SDL_realloc(buffers->z, capacity * sizeof(float));
+    if (z) buffers->z = z;
+    float *r = SDL_realloc(buffers->r, capacity * sizeof(float));
+    if (r) buffers->r = r;
+    Uint32 *visible = SDL_realloc(buffers->visible, capacity * sizeof(Uint32));
+    if (visible) buffers->visible = visible;
+
+    if (!x || !y || !z || !r || !visible) {
+        SDL_Log("Failed to grow cull buffers to %d", capacity);
+        return false;
+    }
+
+    buffers->capacity = capacity;
+    return true;
+}
+
+void cull_buffers_release(CullBuffers *buffers)
+{
+    SDL_free(buffers->x);
+    SDL_free(buffers->y);
+    SDL_free(buffers->z);
+    SDL_free(buffers->r);
+    SDL_free(buffers->visible);
+    SDL_zerop(buffers);
+}
+
+static bool sphere_visible(const vec4 planes[6], float x, float y, float z, float r)
+{
+    for (int p = 0; p < 6; p++) {
+        if (planes[p][0] * x + planes[p][1] * y + planes[p][2] * z + planes[p][3] < -r) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Tests spheres against the frustum four at a time and writes the indices
+// of the ones that are at least partly inside. Returns the visible count.
+int cull_spheres(const vec4 planes[6], const CullBuffers *spheres, int count, Uint32 *visible)
+{
+    int out = 0;
+    int i = 0;
+
+#if defined(SDL_SSE_INTRINSICS)
+    __m128 px[6], py[6], pz[6], pw[6];
+    for (int p = 0; p < 6; p++) {
+        px[p] = _mm_set1_ps(planes[p][0]);
+        py[p] = _mm_set1_ps(planes[p][1]);
+        pz[p] = _mm_set1_ps(planes[p][2]);
+        pw[p] = _mm_set1_ps(planes[p][3]);
+    }
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(&spheres->x[i]);
+        __m128 y = _mm_loadu_ps(&spheres->y[i]);
+        __m128 z = _mm_loadu_ps(&spheres->z[i]);
+        __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres->r[i]));
+
+        __m128 inside = _mm_cmpeq_ps(x, x);
+        for (int p = 0; p < 6; p++) {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)),
+                                  _mm_add_ps(_mm_mul_ps(pz[p], z), pw[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, neg_r));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        while (mask) {
+            int bit = 0;
+            while (!(mask & (1 << bit))) bit++;
+            visible[out++] = (Uint32) (i + bit);
+            mask &= mask - 1;
+        }
+    }
+#elif defined(SDL_NEON_INTRINSICS)
+    float32x4_t px[6], py[6], pz[6], pw[6];
+    for (int p = 0; p < 6; p++) {
+        px[p] = vdupq_n_f32(planes[p][0]);
+        py[p] = vdupq_n_f32(planes[p][1]);
+        pz[p] = vdupq_n_f32(planes[p][2]);
+        pw[p] = vdupq_n_f32(planes[p][3]);
+    }
+
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t x = vld1q_f32(&spheres->x[i]);
+        float32x4_t y = vld1q_f32(&spheres->y[i]);
+        float32x4_t z = vld1q_f32(&spheres->z[i]);
+        float32x4_t neg_r = vnegq_f32(vld1q_f32(&spheres->r[i]));
+
+        uint32x4_t inside = vdupq_n_u32(0xffffffffu);
+        for (int p = 0; p < 6; p++) {
+            float32x4_t d = vmlaq_f32(vmlaq_f32(vmlaq_f32(pw[p], px[p], x), py[p], y), pz[p], z);
+            inside = vandq_u32(inside, vcgeq_f32(d, neg_r));
+        }
+
+        Uint32 lanes[4];
+        vst1q_u32(lanes, inside);
+        for (int lane = 0; lane < 4; lane++) {
+            if (lanes[lane]) visible[out++] = (Uint32) (i + lane);
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        if (sphere_visible(planes, spheres->x[i], spheres->y[i], spheres->z[i], spheres->r[i])) {
+            visible[out++] = (Uint32) i;
+        }
+    }
+
+    return out;
+}
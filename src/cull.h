@@ -0,0 +1,9 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "common.h"
+
+bool cull_buffers_reserve(CullBuffers *buffers, int count);
+void cull_buffers_release(CullBuffers *buffers);
+
+int cull_spheres(const vec4 planes[6], const CullBuffers *spheres, int count, Uint32 *visible);
@@ -0,0 +1,196 @@
+#include "drawlist.h"
+#include "game.h"
+
+Uint64 draw_key(DrawOrder order, DrawPass pass, Uint32 pipeline_id, Uint32 mesh_id, float depth01)
+{
+    Uint32 depth_max = (1u << DRAW_KEY_DEPTH_BITS) - 1;
+    Uint32 depth = (Uint32) (SDL_clamp(depth01, 0.0f, 1.0f) * (float) depth_max);
+
+    Uint64 key = ((Uint64) (pass        & 0xf)   << DRAW_KEY_PASS_SHIFT)
+               | ((Uint64) (pipeline_id & 0xff)  << DRAW_KEY_PIPELINE_SHIFT)
+               | ((Uint64) (mesh_id     & 0xfff) << DRAW_KEY_MESH_SHIFT);
+
+    if (order == DRAW_ORDER_FRONT_TO_BACK) {
+        // same fields with the depth moved above the state
+        Uint64 state = (key >> DRAW_KEY_MESH_SHIFT) & (((Uint64) 1 << DRAW_KEY_STATE_BITS) - 1);
+        return (key & ((Uint64) 0xf << DRAW_KEY_PASS_SHIFT))
+             | ((Uint64) depth << (DRAW_KEY_DEPTH_SHIFT + DRAW_KEY_STATE_BITS))
+             | (state << DRAW_KEY_DEPTH_SHIFT);
+    }
+    return key | ((Uint64) depth << DRAW_KEY_DEPTH_SHIFT);
+}
+
+void draw_list_release(DrawList *list)
+{
+    SDL_free(list->items);
+    SDL_free(list->keys);
+    SDL_free(list->order);
+    SDL_free(list->scratch_keys);
+    SDL_free(list->scratch_order);
+    SDL_zerop(list);
+}
+
+void draw_list_reset(DrawList *list)
+{
+    list->count = 0;
+    SDL_zero(list->stats);
+}
+
+static bool draw_list_grow(DrawList *list)
+{
+    int capacity = list->capacity ? list->capacity * 2 : 256;
+
+    DrawItem *items      = SDL_realloc(list->items, capacity * sizeof *items);
+    if (items) list->items = items;
+    Uint64 *keys         = SDL_realloc(list->keys, capacity * sizeof *keys);
+    if (keys) list->keys = keys;
+    Uint32 *order        = SDL_realloc(list->order, capacity * sizeof *order);
+    if (order) list->order = order;
+    Uint64 *scratch_keys = SDL_realloc(list->scratch_keys, capacity * sizeof *scratch_keys);
+    if (scratch_keys) list->scratch_keys = scratch_keys;
+    Uint32 *scratch_order = SDL_realloc(list->scratch_order, capacity * sizeof *scratch_order);
+    if (scratch_order) list->scratch_order = scratch_order;
+
+    if (!items || !keys || !order || !scratch_keys || !scratch_order) {
+        SDL_Log("Failed to grow draw list to %d items", capacity);
+        return false;
+    }
+
+    list->capacity = capacity;
+    return true;
+}
+
+bool draw_list_push(DrawList *list, Uint64 key, const DrawItem *item)
+{
+    if (list->count == list->capacity && !draw_list_grow(list)) {
+        return false;
+    }
+
+    list->items[list->count] = *item;
+    list->keys[list->count] = key;
+    list->count++;
+    return true;
+}
+
+// LSD radix sort, 8 bits per pass. Passes where every key has the same
+// digit are skipped, which is most of them when few states are in use.
+void draw_list_sort(DrawList *list)
+{
+    int n = list->count;
+    Uint64 *keys = list->keys, *keys_tmp = list->scratch_keys;
+    Uint32 *order = list->order, *order_tmp = list->scratch_order;
+
+    for (int i = 0; i < n; i++) order[i] = (Uint32) i;
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        Uint32 counts[256] = {0};
+        for (int i = 0; i < n; i++) {
+            counts[(keys[i] >> shift) & 0xff]++;
+        }
+        if (n == 0 || counts[(keys[0] >> shift) & 0xff] == (Uint32) n) continue;
+
+        Uint32 sum = 0;
+        for (int d = 0; d < 256; d++) {
+            Uint32 c = counts[d];
+            counts[d] = sum;
+            sum += c;
+        }
+        for (int i = 0; i < n; i++) {
+            Uint32 dst = counts[(keys[i] >> shift) & 0xff]++;
+            keys_tmp[dst] = keys[i];
+            order_tmp[dst] = order[i];
+        }
+
+        Uint64 *k = keys; keys = keys_tmp; keys_tmp = k;
+        Uint32 *o = order; order = order_tmp; order_tmp = o;
+    }
+
+    list->keys = keys;
+    list->scratch_keys = keys_tmp;
+    list->order = order;
+    list->scratch_order = order_tmp;
+}
+
+const DrawItem *draw_list_sorted(const DrawList *list, int i)
+{
+    return &list->items[list->order[i]];
+}
+
+static bool same_state(const DrawItem *a, const DrawItem *b)
+{
+    return a->pipeline == b->pipeline && a->mesh == b->mesh;
+}
+
+// Walks sorted positions [first, end), merging runs with identical state
+// into one instanced draw and only binding what differs from the previous
+// draw. Sorted position i reads the record in instance_buffer whose index
+// is at instance_offset + i in record_buffer.
+// A depth_pipeline replaces every item's pipeline, for the depth prepass.
+// Materials come with the instances, textures are bound once per pass.
+// Counts are added to stats, so a range can be recorded on any thread as
+// long as each has its own stats.
+void draw_list_record_range(const DrawList *list, int first, int end,
+                            SDL_GPURenderPass *render_pass, SDL_GPUCommandBuffer *cmd_buf,
+                            SDL_GPUBuffer *instance_buffer, SDL_GPUBuffer *record_buffer, Uint32 instance_offset,
+                            SDL_GPUGraphicsPipeline *depth_pipeline, DrawStats *stats)
+{
+    SDL_GPUBuffer *storage_buffers[] = { instance_buffer, record_buffer };
+    SDL_GPUGraphicsPipeline *bound_pipeline = NULL;
+    const Mesh *bound_mesh = NULL;
+
+    int i = first;
+    while (i < end) {
+        const DrawItem *item = draw_list_sorted(list, i);
+
+        // the depth-only pass does not care about pipelines
+        int run = 1;
+        while (i + run < end) {
+            const DrawItem *next = draw_list_sorted(list, i + run);
+            if (depth_pipeline ? next->mesh != item->mesh : !same_state(next, item)) break;
+            run++;
+        }
+
+        SDL_GPUGraphicsPipeline *pipeline = depth_pipeline ? depth_pipeline : item->pipeline;
+        if (pipeline != bound_pipeline) {
+            SDL_BindGPUGraphicsPipeline(render_pass, pipeline);
+            SDL_BindGPUVertexStorageBuffers(render_pass, 0, storage_buffers, SDL_arraysize(storage_buffers));
+            bound_pipeline = pipeline;
+            stats->binds += 2;
+        } else {
+            stats->binds_skipped += 2;
+        }
+
+        if (item->mesh != bound_mesh) {
+            SDL_GPUBufferBinding vert_bindings = {
+                .buffer = item->mesh->vertex_buffer,
+            };
+            SDL_BindGPUVertexBuffers(render_pass, 0, &vert_bindings, 1);
+            SDL_GPUBufferBinding index_bindings = {
+                .buffer = item->mesh->index_buffer,
+            };
+            SDL_BindGPUIndexBuffer(render_pass, &index_bindings, SDL_GPU_INDEXELEMENTSIZE_16BIT);
+            bound_mesh = item->mesh;
+            stats->binds += 2;
+        } else {
+            stats->binds_skipped += 2;
+        }
+
+        DrawUniforms draw = {
+            .instance_offset = instance_offset + (Uint32) i,
+        };
+        SDL_PushGPUVertexUniformData(cmd_buf, 1, &draw, sizeof(draw));
+        SDL_DrawGPUIndexedPrimitives(render_pass, item->mesh->index_count, (Uint32) run, 0, 0, 0);
+        stats->draws++;
+
+        i += run;
+    }
+}
+
+void draw_list_record(DrawList *list, SDL_GPURenderPass *render_pass, SDL_GPUCommandBuffer *cmd_buf,
+                      SDL_GPUBuffer *instance_buffer, SDL_GPUBuffer *record_buffer, Uint32 instance_offset,
+                      SDL_GPUGraphicsPipeline *depth_pipeline)
+{
+    list->stats.items = (Uint32) list->count;
+    draw_list_record_range(list, 0, list->count, render_pass, cmd_buf, instance_buffer,
+                           record_buffer, instance_offset, depth_pipeline, &list->stats);
+}
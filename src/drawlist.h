@@ -0,0 +1,19 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "common.h"
+
+Uint64 draw_key(DrawOrder order, DrawPass pass, Uint32 pipeline_id, Uint32 mesh_id, float depth01);
+
+void draw_list_release(DrawList *list);
+void draw_list_reset(DrawList *list);
+bool draw_list_push(DrawList *list, Uint64 key, const DrawItem *item);
+void draw_list_sort(DrawList *list);
+const DrawItem *draw_list_sorted(const DrawList *list, int i);
+void draw_list_record_range(const DrawList *list, int first, int end,
+                            SDL_GPURenderPass *render_pass, SDL_GPUCommandBuffer *cmd_buf,
+                            SDL_GPUBuffer *instance_buffer, SDL_GPUBuffer *record_buffer, Uint32 instance_offset,
+                            SDL_GPUGraphicsPipeline *depth_pipeline, DrawStats *stats);
+void draw_list_record(DrawList *list, SDL_GPURenderPass *render_pass, SDL_GPUCommandBuffer *cmd_buf,
+                      SDL_GPUBuffer *instance_buffer, SDL_GPUBuffer *record_buffer, Uint32 instance_offset,
+                      SDL_GPUGraphicsPipeline *depth_pipeline);
@@ -0,0 +1,105 @@
+#include "dynres.h"
+
+// APP_DYNAMIC_RESOLUTION=0 pins the scale at 1, APP_FRAME_BUDGET_MS sets
+// the budget, otherwise it is one refresh of the window's display
+void dynres_init(AppState *app)
+{
+    DynamicResolution *dynres = &app->dynres;
+    SDL_zerop(dynres);
+
+    const char *enabled = SDL_getenv("APP_DYNAMIC_RESOLUTION");
+    dynres->enabled = !enabled || SDL_atoi(enabled);
+    dynres->scale = RES_SCALE_MAX;
+    dynres->width = app->window_width;
+    dynres->height = app->window_height;
+
+    const char *budget = SDL_getenv("APP_FRAME_BUDGET_MS");
+    const SDL_DisplayMode *mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(app->window));
+    if (budget) {
+        dynres->budget_ms = (float) SDL_atof(budget);
+    } else if (mode && mode->refresh_rate > 0) {
+        dynres->budget_ms = 1000.0f / mode->refresh_rate;
+    }
+    if (dynres->budget_ms <= 0) {
+        dynres->budget_ms = 1000.0f / 60.0f;
+    }
+}
+
+void dynres_release(AppState *app)
+{
+    DynamicResolution *dynres = &app->dynres;
+    for (int i = 0; i < dynres->count; i++) {
+        SDL_ReleaseGPUFence(app->gpu, dynres->slots[(dynres->head + i) % GPU_TIMING_SLOTS].fence);
+    }
+    SDL_zerop(dynres);
+}
+
+static float smooth(float value, float sample)
+{
+    return value > 0 ? value * 0.9f + sample * 0.1f : sample;
+}
+
+// Collects finished frames and picks this frame's render area. A frame is
+// busy on the gpu from its submit, or from when the previous one finished
+// if that was later, until its fence is seen signaled.
+void dynres_begin_frame(AppState *app)
+{
+    DynamicResolution *dynres = &app->dynres;
+    Uint64 now = SDL_GetTicksNS();
+    dynres->frame_start_ns = now;
+
+    bool sampled = false;
+    while (dynres->count > 0) {
+        GPUTimingSlot *slot = &dynres->slots[dynres->head];
+        if (!SDL_QueryGPUFence(app->gpu, slot->fence)) break;
+
+        Uint64 start = SDL_max(slot->submit_ns, dynres->last_done_ns);
+        dynres->gpu_ms = smooth(dynres->gpu_ms, (float) (now - start) / (float) SDL_NS_PER_MS);
+        dynres->last_done_ns = now;
+        sampled = true;
+
+        SDL_ReleaseGPUFence(app->gpu, slot->fence);
+        dynres->head = (dynres->head + 1) % GPU_TIMING_SLOTS;
+        dynres->count--;
+    }
+
+    // iterations that found no swapchain image land here too, the scale
+    // only moves when a new sample came in
+    if (dynres->enabled && sampled) {
+        // cost goes with the pixel count, the square of the scale; aim a
+        // little under budget and only move a bit per frame to stay stable
+        float frame_ms = SDL_max(dynres->cpu_ms, dynres->gpu_ms);
+        float target = dynres->scale * SDL_sqrtf(dynres->budget_ms * 0.9f / frame_ms);
+        float step = SDL_clamp(target - dynres->scale, -0.05f, 0.02f);
+        if (SDL_fabsf(step) > 0.005f) {
+            dynres->scale = SDL_clamp(dynres->scale + step, RES_SCALE_MIN, RES_SCALE_MAX);
+        }
+    } else if (!dynres->enabled) {
+        dynres->scale = RES_SCALE_MAX;
+    }
+
+    dynres->width = SDL_max((Uint32) ((float) app->window_width * dynres->scale), 1);
+    dynres->height = SDL_max((Uint32) ((float) app->window_height * dynres->scale), 1);
+}
+
+// Submits the frame's last command buffer with a fence for the gpu timing
+// and closes the cpu timing. Without a free slot it submits untimed.
+bool dynres_submit(AppState *app, SDL_GPUCommandBuffer *cmd_buf)
+{
+    DynamicResolution *dynres = &app->dynres;
+    Uint64 now = SDL_GetTicksNS();
+    dynres->cpu_ms = smooth(dynres->cpu_ms, (float) (now - dynres->frame_start_ns) / (float) SDL_NS_PER_MS);
+
+    if (dynres->count == GPU_TIMING_SLOTS) {
+        return SDL_SubmitGPUCommandBuffer(cmd_buf);
+    }
+
+    SDL_GPUFence *fence = SDL_SubmitGPUCommandBufferAndAcquireFence(cmd_buf);
+    if (!fence) return false;
+
+    GPUTimingSlot *slot = &dynres->slots[(dynres->head + dynres->count) % GPU_TIMING_SLOTS];
+    slot->fence = fence;
+    slot->submit_ns = now;
+    dynres->count++;
+    return true;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "common.h"
+
+void dynres_init(AppState *app);
+void dynres_release(AppState *app);
+void dynres_begin_frame(AppState *app);
+bool dynres_submit(AppState *app, SDL_GPUCommandBuffer *cmd_buf);
@@ -0,0 +1,383 @@
+#include "entity.h"
+
+bool entity_store_reserve(EntityStore *store, int count)
+{
+    if (count <= store->capacity) return true;
+
+    int capacity = SDL_max(store->capacity, 64);
+    while (capacity < count) capacity *= 2;
+
+    vec3 *position = SDL_realloc(store->position, capacity * sizeof(vec3));
+    if (position) store->position = position;
+    quat *rotation = SDL_realloc(store->rotation, capacity * sizeof(quat));
+    if (rotation) store->rotation = rotation;
+    Model_ID *model_id = SDL_realloc(store->model_id, capacity * sizeof(Model_ID));
+    if (model_id) store->model_id = model_id;
+    Uint32 *material = SDL_realloc(store->material, capacity * sizeof(Uint32));
+    if (material) store->material = material;
+    Uint32 *flags = SDL_realloc(store->flags, capacity * sizeof(Uint32));
+    if (flags) store->flags = flags;
+    Uint32 *slot = SDL_realloc(store->slot, capacity * sizeof(Uint32));
+    if (slot) store->slot = slot;
+    Uint32 *parent = SDL_realloc(store->parent, capacity * sizeof(Uint32));
+    if (parent) store->parent = parent;
+    mat3x4 *world = SDL_realloc(store->world, capacity * sizeof(mat3x4));
+    if (world) store->world = world;
+
+    if (!position || !rotation || !model_id || !material || !flags || !slot
+        || !parent || !world) {
+        SDL_Log("Failed to grow entity store to %d", capacity);
+        return false;
+    }
+
+    store->capacity = capacity;
+    return true;
+}
+
+static bool reserve_slots(EntityStore *store, int count)
+{
+    if (count <= store->slot_capacity) return true;
+
+    int capacity = SDL_max(store->slot_capacity, 64);
+    while (capacity < count) capacity *= 2;
+
+    Uint32 *dense = SDL_realloc(store->slot_dense, capacity * sizeof(Uint32));
+    if (dense) store->slot_dense = dense;
+    Uint32 *generation = SDL_realloc(store->slot_generation, capacity * sizeof(Uint32));
+    if (generation) store->slot_generation = generation;
+    Uint32 *first_child = SDL_realloc(store->first_child, capacity * sizeof(Uint32));
+    if (first_child) store->first_child = first_child;
+    Uint32 *next_sibling = SDL_realloc(store->next_sibling, capacity * sizeof(Uint32));
+    if (next_sibling) store->next_sibling = next_sibling;
+    Uint32 *prev_sibling = SDL_realloc(store->prev_sibling, capacity * sizeof(Uint32));
+    if (prev_sibling) store->prev_sibling = prev_sibling;
+    Uint8 *dirty = SDL_realloc(store->dirty, capacity * sizeof(Uint8));
+    if (dirty) store->dirty = dirty;
+    Uint32 *dirty_slots = SDL_realloc(store->dirty_slots, capacity * sizeof(Uint32));
+    if (dirty_slots) store->dirty_slots = dirty_slots;
+
+    if (!dense || !generation || !first_child || !next_sibling || !prev_sibling || !dirty || !dirty_slots) {
+        SDL_Log("Failed to grow entity slots to %d", capacity);
+        return false;
+    }
+
+    store->slot_capacity = capacity;
+    return true;
+}
+
+void entity_store_release(EntityStore *store)
+{
+    SDL_free(store->position);
+    SDL_free(store->rotation);
+    SDL_free(store->model_id);
+    SDL_free(store->material);
+    SDL_free(store->flags);
+    SDL_free(store->slot);
+    SDL_free(store->parent);
+    SDL_free(store->world);
+    SDL_free(store->slot_dense);
+    SDL_free(store->slot_generation);
+    SDL_free(store->first_child);
+    SDL_free(store->next_sibling);
+    SDL_free(store->prev_sibling);
+    SDL_free(store->dirty);
+    SDL_free(store->dirty_slots);
+    SDL_zerop(store);
+}
+
+static void mark_changed(EntityStore *store, int first, int end)
+{
+    if (store->changed_first >= store->changed_end) {
+        store->changed_first = first;
+        store->changed_end = end;
+    } else {
+        store->changed_first = SDL_min(store->changed_first, first);
+        store->changed_end = SDL_max(store->changed_end, end);
+    }
+}
+
+void entity_store_clear_changes(EntityStore *store)
+{
+    store->changed_first = 0;
+    store->changed_end = 0;
+}
+
+// queues the slot once, a freed slot stays queued for whoever reuses it
+static void mark_dirty(EntityStore *store, Uint32 slot)
+{
+    if (store->dirty[slot]) return;
+    store->dirty[slot] = 1;
+    store->dirty_slots[store->dirty_count++] = slot;
+}
+
+static void link_child(EntityStore *store, Uint32 parent, Uint32 slot)
+{
+    store->first_child[slot] = ENTITY_SLOT_NONE;
+    store->prev_sibling[slot] = ENTITY_SLOT_NONE;
+    store->next_sibling[slot] = ENTITY_SLOT_NONE;
+    if (parent == ENTITY_SLOT_NONE) return;
+
+    Uint32 next = store->first_child[parent];
+    store->next_sibling[slot] = next;
+    if (next != ENTITY_SLOT_NONE) store->prev_sibling[next] = slot;
+    store->first_child[parent] = slot;
+}
+
+static void unlink_child(EntityStore *store, Uint32 parent, Uint32 slot)
+{
+    if (parent == ENTITY_SLOT_NONE) return;
+
+    Uint32 prev = store->prev_sibling[slot];
+    Uint32 next = store->next_sibling[slot];
+    if (prev != ENTITY_SLOT_NONE) {
+        store->next_sibling[prev] = next;
+    } else {
+        store->first_child[parent] = next;
+    }
+    if (next != ENTITY_SLOT_NONE) store->prev_sibling[next] = prev;
+}
+
+// Appends the entity to the dense arrays and gives it a slot, reusing a
+// free one first. The parent must be live, and static when the entity is.
+// Returns ENTITY_NONE on failure.
+EntityHandle entity_spawn(EntityStore *store, const Entity *entity)
+{
+    // a zeroed store has no free list yet
+    if (store->slot_count == 0) store->free_slot = ENTITY_SLOT_NONE;
+
+    int parent = -1;
+    if (entity->parent.generation != 0) {
+        parent = entity_lookup(store, entity->parent);
+        if (parent < 0) {
+            SDL_Log("Failed to spawn entity: stale parent handle");
+            return ENTITY_NONE;
+        }
+        // it would move with the parent behind the static caches' backs
+        if ((entity->flags & ENTITY_STATIC) && !(store->flags[parent] & ENTITY_STATIC)) {
+            SDL_Log("Failed to spawn entity: static entity under a dynamic parent");
+            return ENTITY_NONE;
+        }
+    }
+
+    if (entity->model_id < 0 || entity->model_id >= MAX_MODELS) {
+        SDL_Log("Failed to spawn entity: model %d out of range", entity->model_id);
+        return ENTITY_NONE;
+    }
+    if (!entity_store_reserve(store, store->count + 1)) return ENTITY_NONE;
+
+    Uint32 slot = store->free_slot;
+    if (slot != ENTITY_SLOT_NONE) {
+        store->free_slot = store->slot_dense[slot];
+    } else {
+        if (!reserve_slots(store, store->slot_count + 1)) return ENTITY_NONE;
+        slot = (Uint32) store->slot_count++;
+        store->slot_generation[slot] = 1;
+        store->dirty[slot] = 0;
+    }
+
+    // appended after its parent, the order holds
+    int i = store->count++;
+    vec3_copy(entity->position, store->position[i]);
+    quat_copy(entity->rotation, store->rotation[i]);
+    store->model_id[i] = entity->model_id;
+    store->material[i] = entity->material;
+    store->flags[i] = entity->flags;
+    store->slot[i] = slot;
+    store->parent[i] = parent >= 0 ? store->slot[parent] : ENTITY_SLOT_NONE;
+    store->slot_dense[slot] = (Uint32) i;
+    link_child(store, store->parent[i], slot);
+    mark_dirty(store, slot);
+    mark_changed(store, i, i + 1);
+    store->model_count[entity->model_id]++;
+
+    store->version++;
+    if (entity->flags & ENTITY_STATIC) store->static_version++;
+    return (EntityHandle) { slot, store->slot_generation[slot] };
+}
+
+static void move_entity(EntityStore *store, int from, int to)
+{
+    vec3_copy(store->position[from], store->position[to]);
+    quat_copy(store->rotation[from], store->rotation[to]);
+    store->model_id[to] = store->model_id[from];
+    store->material[to] = store->material[from];
+    store->flags[to] = store->flags[from];
+    store->slot[to] = store->slot[from];
+    store->parent[to] = store->parent[from];
+    SDL_memcpy(store->world[to], store->world[from], sizeof(mat3x4));
+    store->slot_dense[store->slot[to]] = (Uint32) to;
+    mark_changed(store, to, to + 1);
+}
+
+// Despawns the children first, then fills the gap and frees the slot.
+// Costs the size of the subtree times its depth, not the store size.
+// Returns false for stale handles.
+bool entity_despawn(EntityStore *store, EntityHandle handle)
+{
+    if (entity_lookup(store, handle) < 0) return false;
+
+    Uint32 slot = handle.slot;
+    while (store->first_child[slot] != ENTITY_SLOT_NONE) {
+        Uint32 child = store->first_child[slot];
+        entity_despawn(store, (EntityHandle) { child, store->slot_generation[child] });
+    }
+
+    // the children's despawns may have moved it
+    int i = (int) store->slot_dense[slot];
+    if (store->flags[i] & ENTITY_STATIC) store->static_version++;
+    store->version++;
+    store->model_count[store->model_id[i]]--;
+    unlink_child(store, store->parent[i], slot);
+
+    // The last entity fills the gap, unless its parent sits behind the gap:
+    // then its topmost ancestor there takes the gap and leaves its own spot
+    // to fill the same way, which moves at most the chain of ancestors.
+    // Parents stay ahead of their children without a sort.
+    int last = store->count - 1;
+    int gap = i;
+    while (gap != last) {
+        int from = last;
+        for (Uint32 p = store->parent[from]; p != ENTITY_SLOT_NONE; p = store->parent[from]) {
+            int parent = (int) store->slot_dense[p];
+            if (parent < gap) break;
+            from = parent;
+        }
+        move_entity(store, from, gap);
+        gap = from;
+    }
+    store->count--;
+
+    if (++store->slot_generation[slot] == 0) store->slot_generation[slot] = 1;
+    store->slot_dense[slot] = store->free_slot;
+    store->free_slot = slot;
+    return true;
+}
+
+// Returns the dense index of the entity, or -1 when the handle is stale.
+int entity_lookup(const EntityStore *store, EntityHandle handle)
+{
+    if (handle.generation == 0 || handle.slot >= (Uint32) store->slot_count) return -1;
+    if (store->slot_generation[handle.slot] != handle.generation) return -1;
+    return (int) store->slot_dense[handle.slot];
+}
+
+EntityHandle entity_handle(const EntityStore *store, int index)
+{
+    Uint32 slot = store->slot[index];
+    return (EntityHandle) { slot, store->slot_generation[slot] };
+}
+
+// Call after writing an entity's position or rotation.
+void entity_moved(EntityStore *store, int index)
+{
+    mark_dirty(store, store->slot[index]);
+    mark_changed(store, index, index + 1);
+}
+
+static bool slot_live(const EntityStore *store, Uint32 slot)
+{
+    Uint32 i = store->slot_dense[slot];
+    return i < (Uint32) store->count && store->slot[i] == slot;
+}
+
+static bool ancestor_dirty(const EntityStore *store, Uint32 slot)
+{
+    for (Uint32 p = store->parent[store->slot_dense[slot]]; p != ENTITY_SLOT_NONE;
+         p = store->parent[store->slot_dense[p]]) {
+        if (store->dirty[p]) return true;
+    }
+    return false;
+}
+
+static void update_world(EntityStore *store, Uint32 slot)
+{
+    int i = (int) store->slot_dense[slot];
+    Uint32 p = store->parent[i];
+    if (p == ENTITY_SLOT_NONE) {
+        mat3x4_from_trs(store->position[i], store->rotation[i], VEC3_ONE, store->world[i]);
+    } else {
+        mat3x4 local;
+        mat3x4_from_trs(store->position[i], store->rotation[i], VEC3_ONE, local);
+        mat3x4_mul(store->world[store->slot_dense[p]], local, store->world[i]);
+    }
+    mark_changed(store, i, i + 1);
+}
+
+// parents before children, following the links without a stack
+static void update_subtree(EntityStore *store, Uint32 root)
+{
+    Uint32 slot = root;
+    for (;;) {
+        update_world(store, slot);
+        if (store->first_child[slot] != ENTITY_SLOT_NONE) {
+            slot = store->first_child[slot];
+            continue;
+        }
+        while (slot != root && store->next_sibling[slot] == ENTITY_SLOT_NONE) {
+            slot = store->parent[store->slot_dense[slot]];
+        }
+        if (slot == root) return;
+        slot = store->next_sibling[slot];
+    }
+}
+
+// Recomputes the world matrix of every moved entity and of everything
+// below it. Only the subtrees under the queued slots are walked, one whose
+// ancestor moved too is left to the ancestor's walk.
+void entity_update_transforms(EntityStore *store)
+{
+    for (int d = 0; d < store->dirty_count; d++) {
+        Uint32 slot = store->dirty_slots[d];
+        if (!slot_live(store, slot) || ancestor_dirty(store, slot)) continue;
+        update_subtree(store, slot);
+    }
+    for (int d = 0; d < store->dirty_count; d++) {
+        store->dirty[store->dirty_slots[d]] = 0;
+    }
+    store->dirty_count = 0;
+}
+
+// Brings dst, which only ever takes copies of src, up to date with src.
+// Outside the range src changed since the last copy the two already match,
+// so only that range of the dense arrays is copied, and the slot table only
+// when something spawned or despawned. dst's changed range grows by what
+// was copied. On failure dst keeps its old contents and src its changes.
+bool entity_store_copy(EntityStore *dst, EntityStore *src)
+{
+    if (!entity_store_reserve(dst, src->count)) return false;
+    if (!reserve_slots(dst, src->slot_count)) return false;
+
+    int first = src->changed_first;
+    int end = SDL_min(src->changed_end, src->count);
+    if (first < end) {
+        size_t offset = (size_t) first;
+        size_t n = (size_t) (end - first);
+        SDL_memcpy(dst->position + offset, src->position + offset, n * sizeof(vec3));
+        SDL_memcpy(dst->rotation + offset, src->rotation + offset, n * sizeof(quat));
+        SDL_memcpy(dst->model_id + offset, src->model_id + offset, n * sizeof(Model_ID));
+        SDL_memcpy(dst->material + offset, src->material + offset, n * sizeof(Uint32));
+        SDL_memcpy(dst->flags + offset, src->flags + offset, n * sizeof(Uint32));
+        SDL_memcpy(dst->slot + offset, src->slot + offset, n * sizeof(Uint32));
+        SDL_memcpy(dst->parent + offset, src->parent + offset, n * sizeof(Uint32));
+        SDL_memcpy(dst->world + offset, src->world + offset, n * sizeof(mat3x4));
+        mark_changed(dst, first, end);
+    }
+    dst->count = src->count;
+
+    if (dst->version != src->version) {
+        size_t slots = (size_t) src->slot_count;
+        SDL_memcpy(dst->slot_dense, src->slot_dense, slots * sizeof(Uint32));
+        SDL_memcpy(dst->slot_generation, src->slot_generation, slots * sizeof(Uint32));
+        SDL_memcpy(dst->first_child, src->first_child, slots * sizeof(Uint32));
+        SDL_memcpy(dst->next_sibling, src->next_sibling, slots * sizeof(Uint32));
+        SDL_memcpy(dst->prev_sibling, src->prev_sibling, slots * sizeof(Uint32));
+        dst->slot_count = src->slot_count;
+        dst->free_slot = src->free_slot;
+        SDL_memcpy(dst->model_count, src->model_count, sizeof(dst->model_count));
+        dst->version = src->version;
+        dst->static_version = src->static_version;
+    }
+
+    entity_store_clear_changes(src);
+    return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "common.h"
+
+bool entity_store_reserve(EntityStore *store, int count);
+void entity_store_release(EntityStore *store);
+EntityHandle entity_spawn(EntityStore *store, const Entity *entity);
+bool entity_despawn(EntityStore *store, EntityHandle handle);
+int  entity_lookup(const EntityStore *store, EntityHandle handle);
+EntityHandle entity_handle(const EntityStore *store, int index);
+void entity_moved(EntityStore *store, int index);
+void entity_update_transforms(EntityStore *store);
+bool entity_store_copy(EntityStore *dst, EntityStore *src);
+void entity_store_clear_changes(EntityStore *store);
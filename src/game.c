@@ -1,41 +1,120 @@
 #include "game.h"
 #include "shader.h"
+#include "pipeline.h"
 #include "asset.h"
+#include "gpu.h"
+#include "drawlist.h"
+#include "gpucull.h"
+#include "instances.h"
+#include "cull.h"
+#include "record.h"
+#include "dynres.h"
+#include "rendergraph.h"
+#include "rtpool.h"
+#include "lights.h"
+#include "shadow.h"
+#include "material.h"
+#include "entity.h"
 
-void game_init(AppState *app)
+// Two headlights on each vehicle and a field of colored point lights,
+// APP_LIGHTS sets how many
+static void add_demo_lights(AppState *app)
 {
-    setup_pipeline(app);
+    if (!app->lights.cluster_pipeline) return;
+
+    for (int i = 0; i < app->entities.count; i++) {
+        if (app->entities.model_id[i] > 1) continue;
+        for (int side = -1; side <= 1; side += 2) {
+            Light headlight = {
+                .entity = entity_handle(&app->entities, i),
+                .position = { 0.25f * side, 0.35f, 0.9f },
+                .direction = { 0, -0.15f, 1 },
+                .color = { 12, 11, 9 },
+                .range = 20,
+                .spot = true,
+                .cos_inner = SDL_cosf(12 * RAD_PER_DEG),
+                .cos_outer = SDL_cosf(25 * RAD_PER_DEG),
+            };
+            vec3_normalize(headlight.direction);
+            lights_add(app, &headlight);
+        }
+    }
+
+    int count = LIGHT_COUNT_DEFAULT;
+    if (SDL_getenv("APP_LIGHTS")) count = SDL_max(SDL_atoi(SDL_getenv("APP_LIGHTS")), 0);
+
+    SDL_srand(1);
+    for (int i = 0; i < count; i++) {
+        Light light = {
+            .entity = ENTITY_NONE,
+            .position = { SDL_randf() * 40 - 20, 0.3f + SDL_randf(), SDL_randf() * 40 - 20 },
+            .color = { SDL_randf() * 2, SDL_randf() * 2, SDL_randf() * 2 },
+            .range = 2 + SDL_randf() * 3,
+        };
+        lights_add(app, &light);
+    }
+}
+
+static bool cancel_copy(SDL_GPUCommandBuffer *cmd_buf, SDL_GPUCopyPass *copy_pass)
+{
+    SDL_EndGPUCopyPass(copy_pass);
+    SDL_CancelGPUCommandBuffer(cmd_buf);
+    return false;
+}
+
+bool game_init(AppState *app)
+{
+    if (!setup_pipeline(app)) return false;
+    if (!materials_init(app)) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "failed material setup");
+        return false;
+    }
 
     SDL_GPUCommandBuffer *copy_cmd_buf = SDL_AcquireGPUCommandBuffer(app->gpu);
+    if (!copy_cmd_buf) {
+        SDL_Log("Failed to acquire command buffer\n%s", SDL_GetError());
+        return false;
+    }
     SDL_GPUCopyPass *copy_pass = SDL_BeginGPUCopyPass(copy_cmd_buf);
 
-    SDL_GPUTexture *colormap = load_texture_file(app->gpu, copy_pass, "colormap.png");
+    int colormap = material_layer(app, copy_pass, "colormap.png");
+    if (colormap < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "failed texture loading");
+        return cancel_copy(copy_cmd_buf, copy_pass);
+    }
+    // the crate texture is optional, without it the crate is colormapped
+    int aju = material_layer(app, copy_pass, "aju.jpg");
+    if (aju < 0) aju = colormap;
 
-    Model models[] = {
-        {
-            .mesh = load_obj_file(app->gpu, copy_pass, "tractor-police.obj"),
-            .texture = colormap,
-        },
-        {
-            .mesh = load_obj_file(app->gpu, copy_pass, "race-future.obj"),
-            .texture = colormap,
-        },
-        {
-            .mesh = load_obj_file(app->gpu, copy_pass, "cube.obj"),
-            .texture = load_texture_file(app->gpu, copy_pass, "aju.jpg"),
-        }
-    };
-    app->model_count = sizeof(models) / sizeof(models[0]);
+    // the racer is a tinted variant of the shared colormap
+    Material police_material = { .base_color = { 1, 1, 1, 1 }, .layer = (Uint32) colormap };
+    Material racer_material = { .base_color = { 1, 0.55f, 0.45f, 1 }, .layer = (Uint32) colormap };
+    Material crate_material = { .base_color = { 1, 1, 1, 1 }, .layer = (Uint32) aju };
+    int police = material_add(app, &police_material);
+    int racer = material_add(app, &racer_material);
+    int crate = material_add(app, &crate_material);
+    if (police < 0 || racer < 0 || crate < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "failed material setup");
+        return cancel_copy(copy_cmd_buf, copy_pass);
+    }
+
+    const char *meshfiles[] = { "tractor-police.obj", "race-future.obj", "cube.obj" };
+    app->model_count = sizeof(meshfiles) / sizeof(meshfiles[0]);
     if (app->model_count > MAX_MODELS) {
         SDL_Log("models overflow: expected < %d (got %d)", MAX_MODELS, app->model_count);
-        SDL_Quit();
+        return cancel_copy(copy_cmd_buf, copy_pass);
+    }
+    for (int m = 0; m < app->model_count; m++) {
+        if (!load_obj_file(app->gpu, copy_pass, meshfiles[m], &app->models[m].mesh)) {
+            SDL_LogError(SDL_LOG_CATEGORY_ERROR, "failed model loading");
+            return cancel_copy(copy_cmd_buf, copy_pass);
+        }
     }
-    SDL_memcpy(app->models, models, sizeof(models));
 
     SDL_EndGPUCopyPass(copy_pass);
     if (!SDL_SubmitGPUCommandBuffer(copy_cmd_buf)) {
         SDL_LogError(SDL_LOG_CATEGORY_ERROR, "failed model loading");
-        SDL_Quit();
+        return false;
     }
 
     quat r1 = {0}, r2 = {0};
@@ -46,24 +125,39 @@ void game_init(AppState *app)
             .model_id = 0,
             .position = { 2.5f, 0, 0 },
             .rotation = { r1[0], r1[1], r1[2], r1[3] },
+            .material = (Uint32) police,
+            .flags = ENTITY_STATIC,
         },
         {
             .model_id = 1,
             .position = { -2.5f, 0, 0 },
             .rotation = { r2[0], r2[1], r2[2], r2[3] },
+            .material = (Uint32) racer,
+            .flags = ENTITY_STATIC,
         },
         {
             .model_id = 2,
             .position = { 0, 0.8f, 0 },
             .rotation = QUAT_IDENTITY_INIT,
+            .material = (Uint32) crate,
         },
     };
-    app->entity_count = sizeof(entities) / sizeof(entities[0]);
-    if (app->entity_count > MAX_ENTITIES) {
-        SDL_Log("models overflow: expected < %d (got %d)", MAX_ENTITIES, app->entity_count);
-        SDL_Quit();
+    EntityHandle handles[sizeof(entities) / sizeof(entities[0])];
+    for (size_t i = 0; i < sizeof(entities) / sizeof(entities[0]); i++) {
+        handles[i] = entity_spawn(&app->entities, &entities[i]);
+        if (handles[i].generation == 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_ERROR, "failed to spawn entity %d", (int) i);
+            return false;
+        }
     }
-    SDL_memcpy(app->entities, entities, sizeof(entities));
+    app->crate = handles[2];
+    entity_update_transforms(&app->entities);
+
+    app->traffic.cart_material[0] = (Uint32) police;
+    app->traffic.cart_material[1] = (Uint32) racer;
+    app->traffic.rider_material = (Uint32) crate;
+
+    add_demo_lights(app);
 
     app->rotate = true;
 
@@ -73,146 +167,651 @@ void game_init(AppState *app)
     vec3 cam_tar = { 0, EYE_HEIGHT, 0 };
     SDL_memcpy(app->camera.position, cam_pos, sizeof(vec3));
     SDL_memcpy(app->camera.target, cam_tar, sizeof(vec3));
+    return true;
+}
+
+// A cart with a crate on its roof and a spinning one on top of that
+static EntityHandle spawn_cart(AppState *app, Model_ID model_id)
+{
+    Traffic *traffic = &app->traffic;
+    Entity cart = {
+        .model_id = model_id,
+        .position = { TRAFFIC_START_X, 0, TRAFFIC_LANE_Z },
+        .rotation = QUAT_IDENTITY_INIT,
+        .material = traffic->cart_material[model_id],
+    };
+    quat_angle_axis(90 * RAD_PER_DEG, YUP, cart.rotation);
+    EntityHandle handle = entity_spawn(&app->entities, &cart);
+    if (handle.generation == 0) return ENTITY_NONE;
+
+    Entity rider = {
+        .model_id = 2,
+        .position = { 0, 1.0f, 0 },
+        .rotation = QUAT_IDENTITY_INIT,
+        .material = traffic->rider_material,
+        .parent = handle,
+    };
+    rider.parent = entity_spawn(&app->entities, &rider);
+    if (rider.parent.generation != 0) entity_spawn(&app->entities, &rider);
+    return handle;
+}
+
+// F9 starts the traffic, turning it off clears the lane. Carts despawn
+// oldest first, so every despawn moves entities from the end of the
+// store into the gap and the hierarchy order gets restored afterwards.
+static void update_traffic(AppState *app, float dt)
+{
+    Traffic *traffic = &app->traffic;
+    EntityStore *entities = &app->entities;
+
+    if (!app->sim_input.traffic) {
+        for (int k = 0; k < traffic->count; k++) {
+            entity_despawn(entities, traffic->carts[(traffic->first + k) % TRAFFIC_MAX]);
+        }
+        traffic->first = 0;
+        traffic->count = 0;
+        traffic->spawn_timer = 0;
+        return;
+    }
+
+    traffic->spawn_timer -= dt;
+    if (traffic->spawn_timer <= 0 && traffic->count < TRAFFIC_MAX) {
+        EntityHandle cart = spawn_cart(app, (Model_ID) (SDL_rand(2)));
+        if (cart.generation != 0) {
+            traffic->carts[(traffic->first + traffic->count) % TRAFFIC_MAX] = cart;
+            traffic->count++;
+        }
+        traffic->spawn_timer = TRAFFIC_INTERVAL;
+    }
+
+    quat spin;
+    quat_angle_axis(ROTATION_SPEED * dt, YUP, spin);
+    for (int k = 0; k < traffic->count; k++) {
+        int e = entity_lookup(entities, traffic->carts[(traffic->first + k) % TRAFFIC_MAX]);
+        if (e < 0) continue;
+        entities->position[e][0] += TRAFFIC_SPEED * dt;
+        entity_moved(entities, e);
+    }
+    // the top crate of each stack spins on the one below
+    for (int i = 0; i < entities->count; i++) {
+        Uint32 parent = entities->parent[i];
+        if (parent == ENTITY_SLOT_NONE) continue;
+        Uint32 grandparent = entities->parent[entities->slot_dense[parent]];
+        if (grandparent == ENTITY_SLOT_NONE) continue;
+        quat_mul(entities->rotation[i], spin, entities->rotation[i]);
+        entity_moved(entities, i);
+    }
+
+    while (traffic->count > 0) {
+        EntityHandle oldest = traffic->carts[traffic->first];
+        int e = entity_lookup(entities, oldest);
+        if (e >= 0 && entities->position[e][0] < TRAFFIC_END_X) break;
+        entity_despawn(entities, oldest);
+        traffic->first = (traffic->first + 1) % TRAFFIC_MAX;
+        traffic->count--;
+    }
 }
 
 void game_update(AppState *app)
 {
     if (app->rotate) {
-        quat rotation_y;
-        quat_angle_axis(ROTATION_SPEED * app->time.delta_time, YUP, rotation_y);
-        quat_mul(app->entities[2].rotation, rotation_y, app->entities[2].rotation);
+        int crate = entity_lookup(&app->entities, app->crate);
+        if (crate >= 0) {
+            quat rotation_y;
+            quat_angle_axis(ROTATION_SPEED * app->time.delta_time, YUP, rotation_y);
+            quat_mul(app->entities.rotation[crate], rotation_y, app->entities.rotation[crate]);
+            entity_moved(&app->entities, crate);
+        }
     }
+    update_traffic(app, app->time.delta_time);
+    entity_update_transforms(&app->entities);
     update_camera(app, app->time.delta_time);
 }
 
-void game_render(AppState *app, SDL_GPUCommandBuffer *cmd_buf, SDL_GPUTexture *swapchain_tex)
+// Publishes the finished update to the renderer. Only call while no
+// update is in flight. On failure the snapshot keeps the previous update
+// and the entity changes carry over to the next call.
+bool game_snapshot(AppState *app)
 {
-    mat4 proj_mat, view_mat, model_mat;
-    perspective_lh_zo(
-        60.0f * RAD_PER_DEG,
-        (float)app->window_width / (float)app->window_height,
-        0.01f,
-        1000.0f,
-        proj_mat
-    );
-    lookat_lh(app->camera.position, app->camera.target, YUP, view_mat);
+    RenderSnapshot *snap = &app->snapshot;
+    if (!entity_store_copy(&snap->entities, &app->entities)) {
+        SDL_Log("Failed to snapshot %d entities", app->entities.count);
+        return false;
+    }
+    snap->camera = app->camera;
+    snap->look = app->look;
+    return true;
+}
 
-    SDL_GPUColorTargetInfo color_target = {
-        .texture = swapchain_tex,
+// Emits one keyed item per visible entity and writes their record indices
+// into frame_data in sorted order, so every run of equal state is a
+// contiguous range. Returns the index of the first one, or -1.
+static Sint64 build_draw_list(AppState *app, const mat4 view_mat, const vec4 planes[6])
+{
+    const EntityStore *entities = &app->snapshot.entities;
+    DrawList *list = &app->draw_list;
+    draw_list_reset(list);
+
+    // world-space bounding spheres, culled four at a time
+    CullBuffers *cull = &app->cull;
+    int visible_count = 0;
+    if (cull_buffers_reserve(cull, entities->count)) {
+        for (int i = 0; i < entities->count; i++) {
+            const Mesh *mesh = &app->models[entities->model_id[i]].mesh;
+
+            vec3 center;
+            mat3x4_mulv3(entities->world[i], mesh->center, center);
+            cull->x[i] = center[0];
+            cull->y[i] = center[1];
+            cull->z[i] = center[2];
+            cull->r[i] = mesh->radius;
+        }
+        visible_count = cull_spheres(planes, cull, entities->count, cull->visible);
+    }
+    app->cull_stats = (CullStats) {
+        .tested  = (Uint32) entities->count,
+        .visible = (Uint32) visible_count,
+        .culled  = (Uint32) (entities->count - visible_count),
+    };
+
+    bool prepass = app->depth_prepass && app->prepass_pipeline && app->equal_pipeline;
+    SDL_GPUGraphicsPipeline *pipeline = prepass ? app->equal_pipeline : app->pipeline;
+    Uint32 pipeline_key = pipeline_id(app, pipeline);
+    for (int v = 0; v < visible_count; v++) {
+        Uint32 i = cull->visible[v];
+        Model_ID model_id = entities->model_id[i];
+        const vec4 *world = entities->world[i];
+
+        float view_z = view_mat[0][2] * world[0][3]
+                     + view_mat[1][2] * world[1][3]
+                     + view_mat[2][2] * world[2][3]
+                     + view_mat[3][2];
+        float depth01 = (view_z - CAMERA_NEAR) / (CAMERA_FAR - CAMERA_NEAR);
+
+        DrawItem item = {
+            .pipeline = pipeline,
+            .mesh     = &app->models[model_id].mesh,
+            .instance = i,
+        };
+        Uint64 key = draw_key(app->draw_order, DRAW_PASS_OPAQUE, pipeline_key, (Uint32) model_id, depth01);
+        if (!draw_list_push(list, key, &item)) return -1;
+    }
+    draw_list_sort(list);
+
+    Uint32 records_offset = 0;
+    Uint32 *records = transient_buffer_alloc(&app->frame_data, (Uint32) list->count * sizeof(Uint32), sizeof(Uint32),
+                                             &records_offset);
+    if (!records) return -1;
+
+    for (int i = 0; i < list->count; i++) {
+        records[i] = instance_record(app, (int) draw_list_sorted(list, i)->instance);
+    }
+    return records_offset / sizeof(Uint32);
+}
+
+// What the scene passes read while the graph runs, on game_render's stack
+typedef struct {
+    const FrameUniforms *ubo;
+    vec4 *planes;
+    vec4 *view_mat;
+    vec4 *proj_mat;
+    Uint32 instance_offset;
+    Uint32 width;               // render area
+    Uint32 height;
+    int slices;
+    bool gpu_driven;
+    bool lit;
+    bool ready;                 // false draws nothing, out of transient or list space
+    int color;                  // graph resources
+    int depth;
+    int hiz;
+    int shadow_cache;
+    int shadow;
+} SceneFrame;
+
+static void shadow_static_pass(GraphContext *ctx, void *userdata)
+{
+    (void) userdata;
+    set_render_area(ctx->render_pass, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+    shadow_draw(ctx->app, ctx->render_pass, ctx->cmd_buf, true);
+    shadow_cached(ctx->app);
+}
+
+// starts this frame's map from the cached static casters
+static void shadow_copy_pass(GraphContext *ctx, void *userdata)
+{
+    SceneFrame *frame = userdata;
+    ShadowCache *shadow = &ctx->app->shadow;
+    shadow->texture = render_graph_texture(ctx->graph, frame->shadow);
+
+    SDL_GPUCopyPass *copy_pass = SDL_BeginGPUCopyPass(ctx->cmd_buf);
+    SDL_GPUTextureLocation src = {
+        .texture = shadow->static_texture,
+    };
+    SDL_GPUTextureLocation dst = {
+        .texture = shadow->texture,
+    };
+    SDL_CopyGPUTextureToTexture(copy_pass, &src, &dst, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1, false);
+    SDL_EndGPUCopyPass(copy_pass);
+}
+
+static void shadow_dynamic_pass(GraphContext *ctx, void *userdata)
+{
+    (void) userdata;
+    set_render_area(ctx->render_pass, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+    shadow_draw(ctx->app, ctx->render_pass, ctx->cmd_buf, false);
+}
+
+static void light_cluster_pass(GraphContext *ctx, void *userdata)
+{
+    SceneFrame *frame = userdata;
+    lights_cluster(ctx->app, ctx->cmd_buf, frame->view_mat, frame->proj_mat, frame->width, frame->height);
+}
+
+static void cull_early_pass(GraphContext *ctx, void *userdata)
+{
+    SceneFrame *frame = userdata;
+    gpu_cull_dispatch(ctx->app, ctx->cmd_buf, frame->planes, frame->view_mat, frame->proj_mat, GPU_CULL_EARLY);
+}
+
+// lays down depth without color so the color pass only shades the visible
+// fragment of every pixel
+static void depth_prepass(GraphContext *ctx, void *userdata)
+{
+    SceneFrame *frame = userdata;
+    AppState *app = ctx->app;
+    set_render_area(ctx->render_pass, frame->width, frame->height);
+    SDL_PushGPUVertexUniformData(ctx->cmd_buf, 0, frame->ubo, sizeof(*frame->ubo));
+    draw_list_record(&app->draw_list, ctx->render_pass, ctx->cmd_buf, app->instances.buffer,
+                     app->frame_data.buffer, frame->instance_offset, app->prepass_pipeline);
+}
+
+static void opaque_pass(GraphContext *ctx, void *userdata)
+{
+    SceneFrame *frame = userdata;
+    AppState *app = ctx->app;
+    set_render_area(ctx->render_pass, frame->width, frame->height);
+    if (!frame->ready) return;
+
+    SDL_PushGPUVertexUniformData(ctx->cmd_buf, 0, frame->ubo, sizeof(*frame->ubo));
+    materials_bind(app, ctx->render_pass);
+    lights_bind(app, ctx->render_pass, ctx->cmd_buf, frame->width, frame->height);
+    if (frame->gpu_driven) {
+        gpu_cull_draw(app, ctx->render_pass, ctx->cmd_buf, GPU_CULL_EARLY);
+    } else {
+        draw_list_record(&app->draw_list, ctx->render_pass, ctx->cmd_buf, app->instances.buffer,
+                         app->frame_data.buffer, frame->instance_offset, NULL);
+    }
+}
+
+// Everything recorded so far, the upload included, is submitted before the
+// slices, the passes after continue in a new command buffer.
+static void parallel_opaque_pass(GraphContext *ctx, void *userdata)
+{
+    SceneFrame *frame = userdata;
+    AppState *app = ctx->app;
+    RenderGraph *graph = ctx->graph;
+    SDL_SubmitGPUCommandBuffer(ctx->cmd_buf);
+
+    RecordTarget target = {
+        .color_texture = render_graph_texture(graph, frame->color),
+        .depth_texture = render_graph_texture(graph, frame->depth),
+        .color_load_op = render_graph_load_op(graph, ctx->pass, frame->color),
+        .color_store_op = render_graph_store_op(graph, ctx->pass, frame->color),
+        .depth_load_op = render_graph_load_op(graph, ctx->pass, frame->depth),
+        .depth_store_op = render_graph_store_op(graph, ctx->pass, frame->depth),
+        .width = frame->width,
+        .height = frame->height,
         .clear_color = app->clear_color,
-        .load_op = SDL_GPU_LOADOP_CLEAR,
-        .store_op = SDL_GPU_STOREOP_STORE,
+        .uniforms = frame->ubo,
+        .uniforms_size = sizeof(*frame->ubo),
+        .instance_offset = frame->instance_offset,
     };
-    SDL_GPUDepthStencilTargetInfo depth_target_info = {
-        .texture = app->depth_texture,
-        .load_op = SDL_GPU_LOADOP_CLEAR,
-        .clear_depth = 1,
-        .store_op = SDL_GPU_STOREOP_DONT_CARE,
+    record_draw_list_parallel(app, &target, frame->slices);
+
+    ctx->cmd_buf = SDL_AcquireGPUCommandBuffer(app->gpu);
+    if (!ctx->cmd_buf) {
+        SDL_Log("SDL_AcquireGPUCommandBuffer failed\n%s", SDL_GetError());
+    }
+}
+
+// reduces the early depth into the pyramid the late phase tests against
+static void hiz_pass(GraphContext *ctx, void *userdata)
+{
+    SceneFrame *frame = userdata;
+    gpu_cull_build_hiz(ctx->app, ctx->cmd_buf, render_graph_texture(ctx->graph, frame->depth),
+                       frame->width, frame->height);
+}
+
+static void cull_late_pass(GraphContext *ctx, void *userdata)
+{
+    SceneFrame *frame = userdata;
+    gpu_cull_dispatch(ctx->app, ctx->cmd_buf, frame->planes, frame->view_mat, frame->proj_mat, GPU_CULL_LATE);
+}
+
+static void opaque_late_pass(GraphContext *ctx, void *userdata)
+{
+    SceneFrame *frame = userdata;
+    set_render_area(ctx->render_pass, frame->width, frame->height);
+    SDL_PushGPUVertexUniformData(ctx->cmd_buf, 0, frame->ubo, sizeof(*frame->ubo));
+    materials_bind(ctx->app, ctx->render_pass);
+    lights_bind(ctx->app, ctx->render_pass, ctx->cmd_buf, frame->width, frame->height);
+    gpu_cull_draw(ctx->app, ctx->render_pass, ctx->cmd_buf, GPU_CULL_LATE);
+}
+
+// Declares this frame's passes. The light and cull dispatches write buffers
+// the graph doesn't track, so they are kept and ordered by hand before the
+// draws that read them.
+static void build_scene_graph(AppState *app, SceneFrame *frame)
+{
+    RenderGraph *graph = &app->graph;
+    render_graph_begin(graph);
+
+    // window sized, rounded up so resizing doesn't churn the pool
+    RenderTargetDesc color_desc = {
+        .format = app->swapchain_texture_format,
+        .usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET | SDL_GPU_TEXTUREUSAGE_SAMPLER,
+        .width = rt_pool_size(app->window_width),
+        .height = rt_pool_size(app->window_height),
+        .num_levels = 1,
+        .sample_count = SDL_GPU_SAMPLECOUNT_1,
     };
-    SDL_GPURenderPass *render_pass = SDL_BeginGPURenderPass(cmd_buf, &color_target, 1, &depth_target_info);
+    // sampled by the hiz pyramid build
+    RenderTargetDesc depth_desc = color_desc;
+    depth_desc.format = app->depth_texture_format;
+    depth_desc.usage = SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET | SDL_GPU_TEXTUREUSAGE_SAMPLER;
+    frame->color = render_graph_create(graph, "scene color", &color_desc);
+    frame->depth = render_graph_create(graph, "scene depth", &depth_desc);
+    frame->hiz = render_graph_import(graph, "hiz", app->gpu_cull.hiz_texture, false);
+    // blitted to the swapchain after the graph
+    render_graph_export(graph, frame->color);
 
-    for (int i = 0; i < app->entity_count; i++) {
-        const Entity entity = app->entities[i];
-        mat4_from_trs(entity.position, entity.rotation, VEC3_ONE, model_mat);
+    bool prepass = !frame->gpu_driven && app->depth_prepass && app->prepass_pipeline && app->equal_pipeline;
+    int pass;
 
-        mat4 *matrices[3] = {
-            &proj_mat,
-            &view_mat,
-            &model_mat,
-        };
-        UniformBufferObject ubo = {0};
-        mat4_mulN(matrices, 3, ubo.mvp);
-
-        SDL_PushGPUVertexUniformData(cmd_buf, 0, &ubo, sizeof(ubo));
-        SDL_BindGPUGraphicsPipeline(render_pass, app->pipeline);
-        const Model *model = &app->models[entity.model_id];
-        SDL_GPUBufferBinding vert_bindings = {
-            .buffer = model->mesh.vertex_buffer,
-        };
-        SDL_BindGPUVertexBuffers(render_pass, 0, &vert_bindings, 1);
-        SDL_GPUBufferBinding index_bindings = {
-            .buffer = model->mesh.index_buffer,
-        };
-        SDL_BindGPUIndexBuffer(render_pass, &index_bindings, SDL_GPU_INDEXELEMENTSIZE_16BIT);
-        SDL_GPUTextureSamplerBinding tex_bindings = {
-            .sampler = app->sampler,
-            .texture = model->texture,
+    if (frame->lit && frame->ready) {
+        pass = render_graph_add_pass(graph, "light clusters", GRAPH_PASS_CUSTOM, light_cluster_pass, frame);
+        render_graph_keep(graph, pass);
+
+        // the cache outlives the frame, so it is imported and exported
+        RenderTargetDesc shadow_desc = {
+            .format = app->depth_texture_format,
+            .usage = SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET | SDL_GPU_TEXTUREUSAGE_SAMPLER,
+            .width = SHADOW_MAP_SIZE,
+            .height = SHADOW_MAP_SIZE,
+            .num_levels = 1,
+            .sample_count = SDL_GPU_SAMPLECOUNT_1,
         };
-        SDL_BindGPUFragmentSamplers(render_pass, 0, &tex_bindings, 1);
-        SDL_DrawGPUIndexedPrimitives(render_pass, model->mesh.index_count, 1, 0, 0, 0);
+        frame->shadow_cache = render_graph_import(graph, "shadow cache", app->shadow.static_texture, true);
+        frame->shadow = render_graph_create(graph, "shadow map", &shadow_desc);
+
+        if (app->shadow.rebuild) {
+            pass = render_graph_add_pass(graph, "shadow static", GRAPH_PASS_RENDER, shadow_static_pass, frame);
+            render_graph_depth(graph, pass, frame->shadow_cache, true);
+        }
+
+        pass = render_graph_add_pass(graph, "shadow copy", GRAPH_PASS_CUSTOM, shadow_copy_pass, frame);
+        render_graph_read(graph, pass, frame->shadow_cache);
+        render_graph_write(graph, pass, frame->shadow);
+
+        pass = render_graph_add_pass(graph, "shadow dynamic", GRAPH_PASS_RENDER, shadow_dynamic_pass, frame);
+        render_graph_depth(graph, pass, frame->shadow, false);
     }
 
+    // the prepass covers the whole list in one pass even when the color
+    // pass is sliced, so depth from every slice rejects fragments in all
+    // a depth clear after the prepass would discard it and cull the pass
+    bool clear_depth = true;
+    if (prepass && frame->ready) {
+        pass = render_graph_add_pass(graph, "depth prepass", GRAPH_PASS_RENDER, depth_prepass, frame);
+        render_graph_depth(graph, pass, frame->depth, true);
+        clear_depth = false;
+    }
+
+    if (frame->slices > 1) {
+        pass = render_graph_add_pass(graph, "opaque (parallel)", GRAPH_PASS_CUSTOM, parallel_opaque_pass, frame);
+        render_graph_color(graph, pass, frame->color, &app->clear_color);
+        render_graph_depth(graph, pass, frame->depth, clear_depth);
+        if (frame->shadow >= 0) render_graph_read(graph, pass, frame->shadow);
+        return;
+    }
+
+    if (frame->gpu_driven && frame->ready) {
+        pass = render_graph_add_pass(graph, "cull early", GRAPH_PASS_CUSTOM, cull_early_pass, frame);
+        render_graph_keep(graph, pass);
+    }
+
+    pass = render_graph_add_pass(graph, "opaque", GRAPH_PASS_RENDER, opaque_pass, frame);
+    render_graph_color(graph, pass, frame->color, &app->clear_color);
+    render_graph_depth(graph, pass, frame->depth, clear_depth);
+    if (frame->shadow >= 0) render_graph_read(graph, pass, frame->shadow);
+
+    if (!frame->gpu_driven || !frame->ready) return;
+
+    // late phase: occlusion test against what the early draws covered
+    pass = render_graph_add_pass(graph, "hiz", GRAPH_PASS_CUSTOM, hiz_pass, frame);
+    render_graph_read(graph, pass, frame->depth);
+    render_graph_write(graph, pass, frame->hiz);
+
+    pass = render_graph_add_pass(graph, "cull late", GRAPH_PASS_CUSTOM, cull_late_pass, frame);
+    render_graph_read(graph, pass, frame->hiz);
+    render_graph_keep(graph, pass);
+
+    // draws over what the early phase left
+    pass = render_graph_add_pass(graph, "opaque late", GRAPH_PASS_RENDER, opaque_late_pass, frame);
+    render_graph_color(graph, pass, frame->color, NULL);
+    render_graph_depth(graph, pass, frame->depth, false);
+    if (frame->shadow >= 0) render_graph_read(graph, pass, frame->shadow);
+}
+
+// Presents the clear color when the scene could not be rendered, the
+// swapchain image would otherwise go out uninitialized
+void game_clear_swapchain(AppState *app, SDL_GPUCommandBuffer *cmd_buf, SDL_GPUTexture *swapchain_tex)
+{
+    SDL_GPUColorTargetInfo color_target = {
+        .texture = swapchain_tex,
+        .clear_color = app->clear_color,
+        .load_op = SDL_GPU_LOADOP_CLEAR,
+        .store_op = SDL_GPU_STOREOP_STORE,
+    };
+    SDL_GPURenderPass *render_pass = SDL_BeginGPURenderPass(cmd_buf, &color_target, 1, NULL);
     SDL_EndGPURenderPass(render_pass);
 }
 
-void setup_pipeline(AppState *app)
+void game_render(AppState *app, SDL_GPUCommandBuffer *cmd_buf, SDL_GPUTexture *swapchain_tex)
 {
-    SDL_GPUShader *vertex_shader = LoadShader(app->gpu, "shader.vert");
-    SDL_GPUShader *fragment_shader = LoadShader(app->gpu, "shader.frag");
-    if (!vertex_shader || !fragment_shader) {
-        SDL_ReleaseGPUShader(app->gpu, vertex_shader);
-        SDL_ReleaseGPUShader(app->gpu, fragment_shader);
+    mat4 proj_mat, view_mat;
+    perspective_lh_zo(
+        CAMERA_FOV,
+        (float)app->window_width / (float)app->window_height,
+        CAMERA_NEAR,
+        CAMERA_FAR,
+        proj_mat
+    );
+
+    // late latch: the snapshot is one update behind, so the look input
+    // latched for the update in flight is applied here again, right before
+    // the view matrix is built, instead of showing up a frame later
+    const Camera *camera = &app->snapshot.camera;
+    Look look = app->snapshot.look;
+    look_apply(&look, app->sim_input.mouse_move);
+    vec3 forward, right, target;
+    look_vectors(&look, forward, right);
+    vec3_add(camera->position, forward, target);
+    lookat_lh(camera->position, target, YUP, view_mat);
+
+    FrameUniforms ubo = {0};
+    mat4_copy(view_mat, ubo.view);
+    mat4_copy(proj_mat, ubo.proj);
+    mat4_mul(proj_mat, view_mat, ubo.view_proj);
 
-        SDL_Log("Failed to load shader(s)\n%s", SDL_GetError());
+    vec4 planes[6];
+    mat4_frustum_planes(ubo.view_proj, planes);
+
+    SceneFrame frame = {
+        .ubo = &ubo,
+        .planes = planes,
+        .view_mat = view_mat,
+        .proj_mat = proj_mat,
+        .width = app->dynres.width,
+        .height = app->dynres.height,
+        .slices = 1,
+        .gpu_driven = app->gpu_culling && app->gpu_cull.cull_pipeline,
+        .lit = app->lights.cluster_pipeline != NULL,
+        .shadow = -1,
+    };
+    // without a pyramid that fits, the cpu path draws this frame
+    if (frame.gpu_driven && !gpu_cull_resize(app, frame.width, frame.height)) {
+        frame.gpu_driven = false;
+    }
+
+    // the scene gets its own command buffer: its fence then times the scene
+    // without the wait for the swapchain image, cmd_buf only does the blit
+    SDL_GPUCommandBuffer *scene_cmd_buf = SDL_AcquireGPUCommandBuffer(app->gpu);
+    if (!scene_cmd_buf) {
+        SDL_Log("SDL_AcquireGPUCommandBuffer failed\n%s", SDL_GetError());
+        game_clear_swapchain(app, cmd_buf, swapchain_tex);
         return;
     }
 
-    SDL_GPUVertexAttribute vertex_attrs[] = {
-        {
-            .location = 0,
-            .format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3,
-            .offset = offsetof(Vertex, pos),
-        },
-        {
-            .location = 1,
-            .format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT4,
-            .offset = offsetof(Vertex, color),
+    // dynamic per-frame data goes into frame_data between begin and upload,
+    // the upload has to land before the passes that read it
+    transient_buffer_begin(app->gpu, &app->frame_data);
+
+    // the static instance records and the material table only go up when
+    // they changed
+    bool inputs_ready = instances_write(app) && materials_upload(app, scene_cmd_buf) && app->materials.buffer
+                     && (!frame.lit || (lights_write(app) && shadow_write(app)));
+    if (frame.gpu_driven) {
+        frame.ready = gpu_cull_write(app) && inputs_ready;
+    } else {
+        Sint64 instance_offset = build_draw_list(app, view_mat, planes);
+        frame.ready = instance_offset >= 0 && inputs_ready;
+        frame.instance_offset = frame.ready ? (Uint32) instance_offset : 0;
+        // large lists are recorded in slices on the job pool
+        if (frame.ready) frame.slices = record_slice_count(app, app->draw_list.count);
+    }
+
+    transient_buffer_upload(app->gpu, &app->frame_data, scene_cmd_buf);
+    instances_upload(app, scene_cmd_buf);
+
+    build_scene_graph(app, &frame);
+    if (!render_graph_compile(app->gpu, &app->graph, &app->targets)) {
+        SDL_Log("render graph: compile failed, skipping the scene");
+        dynres_submit(app, scene_cmd_buf);
+        game_clear_swapchain(app, cmd_buf, swapchain_tex);
+        return;
+    }
+    scene_cmd_buf = render_graph_execute(app, &app->graph, scene_cmd_buf);
+    if (scene_cmd_buf) {
+        dynres_submit(app, scene_cmd_buf);
+    }
+
+    // upscale the render area to the whole swapchain
+    SDL_GPUBlitInfo blit_info = {
+        .source = {
+            .texture = render_graph_texture(&app->graph, frame.color),
+            .w = frame.width,
+            .h = frame.height,
         },
-        {
-            .location = 2,
-            .format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT2,
-            .offset = offsetof(Vertex, uv),
+        .destination = {
+            .texture = swapchain_tex,
+            .w = app->swapchain_width,
+            .h = app->swapchain_height,
         },
+        .load_op = SDL_GPU_LOADOP_DONT_CARE,
+        .filter = SDL_GPU_FILTER_LINEAR,
     };
+    SDL_BlitGPUTexture(cmd_buf, &blit_info);
+}
 
-    SDL_GPUGraphicsPipelineCreateInfo pipeline_createinfo = {
-        .vertex_shader = vertex_shader,
-        .fragment_shader = fragment_shader,
-        .vertex_input_state = (SDL_GPUVertexInputState) {
-            .num_vertex_buffers = 1,
-            .vertex_buffer_descriptions = &(SDL_GPUVertexBufferDescription) {
-                .slot = 0,
-                .pitch = sizeof(Vertex),
-            },
-            .num_vertex_attributes = sizeof(vertex_attrs) / sizeof(vertex_attrs[0]),
-            .vertex_attributes = vertex_attrs,
-        },
-        .primitive_type = SDL_GPU_PRIMITIVETYPE_TRIANGLELIST,
-        .rasterizer_state = (SDL_GPURasterizerState) {
-            .cull_mode = SDL_GPU_CULLMODE_FRONT,
-            // .fill_mode = SDL_GPU_FILLMODE_LINE,
-        },
-        .depth_stencil_state = (SDL_GPUDepthStencilState) {
-            .enable_depth_test = true,
-            .enable_depth_write = true,
-            .compare_op = SDL_GPU_COMPAREOP_LESS,
-        },
-        .target_info = (SDL_GPUGraphicsPipelineTargetInfo) {
-            .num_color_targets = 1,
-            .color_target_descriptions = &(SDL_GPUColorTargetDescription) {
-                .format = app->swapchain_texture_format,
-            },
-            .has_depth_stencil_target = true,
-            .depth_stencil_format = app->depth_texture_format,
-        }
+// Only the scene pipeline and the sampler are required, the prepass,
+// lighting and gpu culling fall back when theirs are missing
+bool setup_pipeline(AppState *app)
+{
+    // without the cluster pass or the shadow map the unlit variants are used
+    if (lights_init(app) && !shadow_init(app)) {
+        lights_release(app);
+    }
+
+    PipelineDesc mesh_desc = pipeline_desc_default(app);
+    Uint32 features = SHADER_FEATURE_TEXTURED | SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_INSTANCED;
+    if (app->lights.cluster_pipeline) features |= SHADER_FEATURE_LIT;
+    shader_variant_name(mesh_desc.vertex_shader, sizeof(mesh_desc.vertex_shader), "shader.vert", features);
+    shader_variant_name(mesh_desc.fragment_shader, sizeof(mesh_desc.fragment_shader), "shader.frag", features);
+
+    PipelineDesc prepass_desc = pipeline_desc_default(app);
+    prepass_desc.vertex_layout = VERTEX_LAYOUT_POSITION;
+    prepass_desc.num_color_targets = 0;
+    prepass_desc.color_format = SDL_GPU_TEXTUREFORMAT_INVALID;
+    shader_variant_name(prepass_desc.vertex_shader, sizeof(prepass_desc.vertex_shader), "shader.vert",
+                        SHADER_FEATURE_INSTANCED | SHADER_FEATURE_DEPTH_ONLY);
+    SDL_strlcpy(prepass_desc.fragment_shader, "depth.frag", sizeof(prepass_desc.fragment_shader));
+
+    // after the prepass only the nearest fragment matches, nothing to write
+    PipelineDesc equal_desc = mesh_desc;
+    equal_desc.depth_compare = SDL_GPU_COMPAREOP_EQUAL;
+    equal_desc.depth_write = false;
+
+    PipelineDesc descs[] = {
+        mesh_desc,
+        prepass_desc,
+        equal_desc,
     };
-    app->pipeline = SDL_CreateGPUGraphicsPipeline(app->gpu, &pipeline_createinfo);
+    pipeline_warmup(app, descs, SDL_arraysize(descs));
 
-    SDL_ReleaseGPUShader(app->gpu, vertex_shader);
-    SDL_ReleaseGPUShader(app->gpu, fragment_shader);
+    app->pipeline = pipeline_get(app, &mesh_desc);
+    if (!app->pipeline) {
+        SDL_Log("Failed to create pipeline %s + %s, are the shaders built? (build.ps1)\n%s",
+                mesh_desc.vertex_shader, mesh_desc.fragment_shader, SDL_GetError());
+        return false;
+    }
+
+    app->prepass_pipeline = pipeline_get(app, &prepass_desc);
+    app->equal_pipeline = pipeline_get(app, &equal_desc);
+    if (!app->prepass_pipeline || !app->equal_pipeline) {
+        SDL_Log("Failed to create depth prepass pipelines, prepass disabled\n%s", SDL_GetError());
+    }
+    // APP_DEPTH_PREPASS=1 starts with the prepass, APP_FRONT_TO_BACK=1
+    // with front-to-back ordering, APP_PARALLEL_RECORDING=0 records every
+    // draw list on the main thread
+    app->depth_prepass = SDL_getenv("APP_DEPTH_PREPASS") && SDL_atoi(SDL_getenv("APP_DEPTH_PREPASS"));
+    app->parallel_recording = !SDL_getenv("APP_PARALLEL_RECORDING") || SDL_atoi(SDL_getenv("APP_PARALLEL_RECORDING"));
+    if (SDL_getenv("APP_FRONT_TO_BACK") && SDL_atoi(SDL_getenv("APP_FRONT_TO_BACK"))) {
+        app->draw_order = DRAW_ORDER_FRONT_TO_BACK;
+    }
+
+    // APP_GPU_CULLING=1 starts on the gpu-driven path, e.g. for headless
+    // runs on a software vulkan driver such as lavapipe
+    if (gpu_cull_init(app)) {
+        app->gpu_culling = SDL_getenv("APP_GPU_CULLING") && SDL_atoi(SDL_getenv("APP_GPU_CULLING"));
+    }
 
     SDL_GPUSamplerCreateInfo sampler_createinfo = { 0 };
     app->sampler = SDL_CreateGPUSampler(app->gpu, &sampler_createinfo);
+    if (!app->sampler) {
+        SDL_Log("Failed to create sampler\n%s", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+void look_apply(Look *look, const vec2 mouse_move)
+{
+    look->yaw   = wrap(look->yaw + mouse_move[0] * LOOK_SENSITIVITY, 360);
+    look->pitch = SDL_clamp(look->pitch - mouse_move[1] * LOOK_SENSITIVITY, -89, 89);
+}
+
+// Calculate look matrix from yaw and pitch and extract the forward and
+// right vectors from it
+void look_vectors(const Look *look, vec3 forward, vec3 right)
+{
+    mat4 look_mat;
+    vec3 angles = { look->pitch * RAD_PER_DEG, look->yaw * RAD_PER_DEG, 0 };
+    euler_xyz(angles, look_mat);
+
+    mat4_mulv3(look_mat, FORWARD, 0, forward);
+    mat4_mulv3(look_mat, RIGHT, 0, right);
 }
 
 void update_camera(AppState *app, float dt)
@@ -221,26 +820,17 @@ void update_camera(AppState *app, float dt)
     Look   *look   = &app->look;
 
     // Handle look input
-    look->yaw   = wrap(look->yaw + app->mouse_move[0] * LOOK_SENSITIVITY, 360);
-    look->pitch = SDL_clamp(look->pitch - app->mouse_move[1] * LOOK_SENSITIVITY, -89, 89);
-    vec2_zero(app->mouse_move);
+    look_apply(look, app->sim_input.mouse_move);
 
     // Handle movement input
     vec2 move_input = { 0, 0 };
-    if      (app->key_down[SDL_SCANCODE_W]) move_input[1] = 1;
-    else if (app->key_down[SDL_SCANCODE_S]) move_input[1] = -1;
-    if      (app->key_down[SDL_SCANCODE_A]) move_input[0] = 1;
-    else if (app->key_down[SDL_SCANCODE_D]) move_input[0] = -1;
+    if      (app->sim_input.key_down[SDL_SCANCODE_W]) move_input[1] = 1;
+    else if (app->sim_input.key_down[SDL_SCANCODE_S]) move_input[1] = -1;
+    if      (app->sim_input.key_down[SDL_SCANCODE_A]) move_input[0] = 1;
+    else if (app->sim_input.key_down[SDL_SCANCODE_D]) move_input[0] = -1;
 
-    // Calculate look matrix from yaw and pitch
-    mat4 look_mat;
-    vec3 angles = { look->pitch * RAD_PER_DEG, look->yaw * RAD_PER_DEG, 0 };
-    euler_xyz(angles, look_mat);
-
-    // Extract forward and right vectors from look matrix
     vec3 forward, right;
-    mat4_mulv3(look_mat, FORWARD, 0, forward);
-    mat4_mulv3(look_mat, RIGHT, 0, right);
+    look_vectors(look, forward, right);
 
     // Calculate movement direction
     vec3 move_dir = { 0, 0, 0 };
@@ -260,4 +850,3 @@ void update_camera(AppState *app, float dt)
     // Set camera target based on look direction
     vec3_add(camera->position, forward, camera->target);
 }
-
@@ -7,19 +7,126 @@
 #define MOVE_SPEED 5
 #define LOOK_SENSITIVITY 0.3f
 #define ROTATION_SPEED (90.0f * RAD_PER_DEG)
+#define TRAFFIC_INTERVAL 0.4f   // seconds between carts
+#define TRAFFIC_SPEED    6.0f
+#define TRAFFIC_LANE_Z   6.0f
+#define TRAFFIC_START_X  (-30.0f)
+#define TRAFFIC_END_X    30.0f
+#define CAMERA_FOV  (60.0f * RAD_PER_DEG)
+#define CAMERA_NEAR 0.01f
+#define CAMERA_FAR  1000.0f
 
+// linear, the moon also casts the shadow
+#define LIGHT_AMBIENT   ((vec3){ 0.03f, 0.03f, 0.04f })
+#define MOON_COLOR      ((vec3){ 0.10f, 0.12f, 0.18f })
+#define MOON_DIRECTION  ((vec3){ 0.3f, 1.0f, -0.4f })    // towards the moon
+
+// per-frame, pushed once for all draws of a pass
+typedef struct {
+    mat4 view;
+    mat4 proj;
+    mat4 view_proj;
+} FrameUniforms;
+
+// per-draw, the record indices of the instances start at this index
+typedef struct {
+    Uint32 instance_offset;
+    Uint32 padding[3];
+} DrawUniforms;
+
+// instance record in InstanceBuffer, read by cull.comp and the vertex shader
+typedef struct {
+    mat3x4 model;
+    vec4 sphere;            // world-space center, radius
+    Uint32 draw;
+    Uint32 material;
+    Uint32 padding[2];
+} GPUInstance;
+
+typedef struct {
+    vec4 base_color;
+    Uint32 layer;
+    Uint32 padding[3];
+} GPUMaterial;
+
+typedef struct {
+    vec4 planes[6];
+    mat4 view;
+    float proj_x;           // projection scale, proj[0][0] and proj[1][1]
+    float proj_y;
+    float znear;
+    float zfar;
+    Uint32 instance_count;
+    Uint32 instance_base;
+    Uint32 draw_first_base;
+    Uint32 phase;           // GPUCullPhase
+    Uint32 draw_base;
+    Uint32 visible_base;
+    Uint32 history;
+    Uint32 occlusion;
+} CullUniforms;
+
+typedef struct {
+    Uint32 src_width;
+    Uint32 src_height;
+    Uint32 dst_width;
+    Uint32 dst_height;
+    Uint32 src_level;
+    Uint32 padding[3];
+} HiZUniforms;
+
+// light record read by light_cluster.comp and the LIT fragment shader
+typedef struct {
+    vec3 position;
+    float range;
+    vec3 color;
+    float spot_scale;       // spot factor is dot(-l, direction) * scale + offset
+    vec3 direction;
+    float spot_offset;
+} GPULight;
+
+typedef struct {
+    mat4 view;
+    float proj_x;
+    float proj_y;
+    float znear;
+    float zfar;
+    float render_width;
+    float render_height;
+    Uint32 light_base;
+    Uint32 light_count;
+    Uint32 index_capacity;
+    Uint32 padding[3];
+} ClusterUniforms;
+
+// fragment slot 0 of the LIT pipelines
 typedef struct {
-    mat4 mvp;
-} UniformBufferObject;
+    mat4 shadow_view_proj;
+    float tile_width;
+    float tile_height;
+    float slice_scale;      // slice = log(view_z) * scale + bias
+    float slice_bias;
+    vec3 ambient;
+    Uint32 light_base;
+    vec3 moon_direction;
+    float padding0;
+    vec3 moon_color;
+    float shadow_normal_offset; // world units along the normal before the lookup
+} LightUniforms;
 
 typedef struct {
     vec3 pos;
     SDL_FColor color;
     vec2 uv;
+    vec3 normal;
 } Vertex;
 
-void game_init(AppState *app);
-void setup_pipeline(AppState *app);
+bool game_init(AppState *app);
+bool setup_pipeline(AppState *app);
 void game_update(AppState *app);
+bool game_snapshot(AppState *app);
 void game_render(AppState *app, SDL_GPUCommandBuffer *cmd_buf, SDL_GPUTexture *swapchain_tex);
+void game_clear_swapchain(AppState *app, SDL_GPUCommandBuffer *cmd_buf, SDL_GPUTexture *swapchain_tex);
 void update_camera(AppState *app, float dt);
+void look_apply(Look *look, const vec2 mouse_move);
+void look_vectors(const Look *look, vec3 forward, vec3 right);
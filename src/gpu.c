@@ -6,7 +6,8 @@ SDL_GPUTexture *upload_texture(
         const void *pixels,
         Uint32 pixels_byte_size,
         Uint32 width,
-        Uint32 height)
+        Uint32 height,
+        const char *name)
 {
     SDL_GPUTextureCreateInfo texture_createinfo = {
         .format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM_SRGB,
@@ -16,13 +17,29 @@ SDL_GPUTexture *upload_texture(
         .layer_count_or_depth = 1,
         .num_levels = 1,
     };
-    SDL_GPUTexture *texture = SDL_CreateGPUTexture(gpu, &texture_createinfo);
+    SDL_GPUTexture *texture = gpumem_create_texture(gpu, &texture_createinfo, GPU_MEM_TEXTURE, name);
 
+    upload_texture_layer(gpu, copy_pass, texture, 0, pixels, pixels_byte_size, width, height, name);
+
+    return texture;
+}
+
+void upload_texture_layer(
+        SDL_GPUDevice *gpu,
+        SDL_GPUCopyPass *copy_pass,
+        SDL_GPUTexture *texture,
+        Uint32 layer,
+        const void *pixels,
+        Uint32 pixels_byte_size,
+        Uint32 width,
+        Uint32 height,
+        const char *name)
+{
     SDL_GPUTransferBufferCreateInfo tex_transbuf_createinfo = {
         .usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD,
         .size = pixels_byte_size,
     };
-    SDL_GPUTransferBuffer *tex_transfer_buf = SDL_CreateGPUTransferBuffer(gpu, &tex_transbuf_createinfo);
+    SDL_GPUTransferBuffer *tex_transfer_buf = gpumem_create_transfer_buffer(gpu, &tex_transbuf_createinfo, name);
 
     void *tex_transfer_mem = SDL_MapGPUTransferBuffer(gpu, tex_transfer_buf, false);
     SDL_memcpy(tex_transfer_mem, pixels, pixels_byte_size);
@@ -33,39 +50,38 @@ SDL_GPUTexture *upload_texture(
     };
     SDL_GPUTextureRegion tex_dst = {
         .texture = texture,
+        .layer = layer,
         .w = width,
         .h = height,
         .d = 1,
     };
     SDL_UploadToGPUTexture(copy_pass, &tex_src, &tex_dst, false);
 
-    SDL_ReleaseGPUTransferBuffer(gpu, tex_transfer_buf);
-
-    return texture;
+    gpumem_release_transfer_buffer(gpu, tex_transfer_buf);
 }
 
 Mesh upload_mesh_bytes(SDL_GPUDevice *gpu, SDL_GPUCopyPass *copy_pass,
                        const void *vertex_bytes, Uint32 vertex_byte_size,
                        const void *index_bytes, Uint32 index_byte_size,
-                       size_t num_indices)
+                       size_t num_indices, const char *name)
 {
     SDL_GPUBufferCreateInfo vertbuf_createinfo = {
         .usage = SDL_GPU_BUFFERUSAGE_VERTEX,
         .size  = vertex_byte_size,
     };
-    SDL_GPUBuffer *vertex_buffer = SDL_CreateGPUBuffer(gpu, &vertbuf_createinfo);
+    SDL_GPUBuffer *vertex_buffer = gpumem_create_buffer(gpu, &vertbuf_createinfo, GPU_MEM_VERTEX, name);
 
     SDL_GPUBufferCreateInfo indbuf_createinfo = {
         .usage = SDL_GPU_BUFFERUSAGE_INDEX,
         .size  = index_byte_size,
     };
-    SDL_GPUBuffer *index_buffer = SDL_CreateGPUBuffer(gpu, &indbuf_createinfo);
+    SDL_GPUBuffer *index_buffer = gpumem_create_buffer(gpu, &indbuf_createinfo, GPU_MEM_INDEX, name);
 
     SDL_GPUTransferBufferCreateInfo transbuf_createinfo = {
         .usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD,
         .size  = vertex_byte_size + index_byte_size,
     };
-    SDL_GPUTransferBuffer *transfer_buf = SDL_CreateGPUTransferBuffer(gpu, &transbuf_createinfo);
+    SDL_GPUTransferBuffer *transfer_buf = gpumem_create_transfer_buffer(gpu, &transbuf_createinfo, name);
 
     void *transfer_mem = SDL_MapGPUTransferBuffer(gpu, transfer_buf, false);
     SDL_memcpy(transfer_mem, vertex_bytes, vertex_byte_size);
@@ -93,7 +109,7 @@ Mesh upload_mesh_bytes(SDL_GPUDevice *gpu, SDL_GPUCopyPass *copy_pass,
     SDL_UploadToGPUBuffer(copy_pass, &vert_location, &vert_region, false);
     SDL_UploadToGPUBuffer(copy_pass, &index_location, &index_region, false);
 
-    SDL_ReleaseGPUTransferBuffer(gpu, transfer_buf);
+    gpumem_release_transfer_buffer(gpu, transfer_buf);
 
     return (Mesh) {
         .vertex_buffer = vertex_buffer,
@@ -101,3 +117,118 @@ Mesh upload_mesh_bytes(SDL_GPUDevice *gpu, SDL_GPUCopyPass *copy_pass,
         .index_count   = (Uint32) num_indices,
     };
 }
+
+bool transient_buffer_create(SDL_GPUDevice *gpu, TransientBuffer *tb, Uint32 capacity, SDL_GPUBufferUsageFlags usage)
+{
+    SDL_GPUBufferCreateInfo buf_createinfo = {
+        .usage = usage,
+        .size  = capacity,
+    };
+    SDL_GPUBuffer *buffer = gpumem_create_buffer(gpu, &buf_createinfo, GPU_MEM_STORAGE, "transient buffer");
+
+    SDL_GPUTransferBufferCreateInfo transbuf_createinfo = {
+        .usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD,
+        .size  = capacity,
+    };
+    SDL_GPUTransferBuffer *transfer_buf = gpumem_create_transfer_buffer(gpu, &transbuf_createinfo, "transient buffer");
+
+    if (!buffer || !transfer_buf) {
+        gpumem_release_buffer(gpu, buffer);
+        gpumem_release_transfer_buffer(gpu, transfer_buf);
+
+        SDL_Log("Failed to create transient buffer (%u bytes)\n%s", capacity, SDL_GetError());
+        return false;
+    }
+
+    *tb = (TransientBuffer) {
+        .transfer_buffer = transfer_buf,
+        .buffer   = buffer,
+        .usage    = usage,
+        .capacity = capacity,
+    };
+    return true;
+}
+
+void transient_buffer_release(SDL_GPUDevice *gpu, TransientBuffer *tb)
+{
+    if (tb->mapped) {
+        SDL_UnmapGPUTransferBuffer(gpu, tb->transfer_buffer);
+    }
+    gpumem_release_transfer_buffer(gpu, tb->transfer_buffer);
+    gpumem_release_buffer(gpu, tb->buffer);
+    SDL_zerop(tb);
+}
+
+void transient_buffer_begin(SDL_GPUDevice *gpu, TransientBuffer *tb)
+{
+    // last frame ran out of space: grow before handing out memory again
+    if (tb->wanted > tb->capacity) {
+        Uint32 capacity = tb->capacity;
+        while (capacity < tb->wanted) capacity *= 2;
+
+        TransientBuffer grown;
+        if (transient_buffer_create(gpu, &grown, capacity, tb->usage)) {
+            transient_buffer_release(gpu, tb);
+            *tb = grown;
+        }
+    }
+
+    // cycle = true: if the gpu still reads last frame's copy we get a fresh one
+    tb->mapped = SDL_MapGPUTransferBuffer(gpu, tb->transfer_buffer, true);
+    tb->offset = 0;
+    tb->wanted = 0;
+}
+
+void *transient_buffer_alloc(TransientBuffer *tb, Uint32 size, Uint32 align, Uint32 *offset)
+{
+    // align need not be a power of two: structured buffers index by stride
+    Uint32 start = (tb->offset + align - 1) / align * align;
+    tb->wanted = (tb->wanted + align - 1) / align * align + size;
+
+    if (UNLIKELY(!tb->mapped || start + size > tb->capacity)) {
+        return NULL;
+    }
+
+    tb->offset = start + size;
+    if (offset) *offset = start;
+    return tb->mapped + start;
+}
+
+void transient_buffer_upload(SDL_GPUDevice *gpu, TransientBuffer *tb, SDL_GPUCommandBuffer *cmd_buf)
+{
+    if (!tb->mapped) return;
+
+    SDL_UnmapGPUTransferBuffer(gpu, tb->transfer_buffer);
+    tb->mapped = NULL;
+
+    if (tb->offset == 0) return;
+
+    SDL_GPUCopyPass *copy_pass = SDL_BeginGPUCopyPass(cmd_buf);
+    SDL_GPUTransferBufferLocation location = {
+        .transfer_buffer = tb->transfer_buffer,
+    };
+    SDL_GPUBufferRegion region = {
+        .buffer = tb->buffer,
+        .size   = tb->offset,
+    };
+    SDL_UploadToGPUBuffer(copy_pass, &location, &region, true);
+    SDL_EndGPUCopyPass(copy_pass);
+}
+
+// Limits a pass to the top-left width x height of its targets, the part the
+// scene is rendered to at the current resolution scale.
+void set_render_area(SDL_GPURenderPass *render_pass, Uint32 width, Uint32 height)
+{
+    SDL_GPUViewport viewport = {
+        .w = (float) width,
+        .h = (float) height,
+        .max_depth = 1,
+    };
+    SDL_SetGPUViewport(render_pass, &viewport);
+
+    SDL_Rect scissor = {
+        .w = (int) width,
+        .h = (int) height,
+    };
+    SDL_SetGPUScissor(render_pass, &scissor);
+}
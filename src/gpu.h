@@ -2,6 +2,7 @@
 
 #include <SDL3/SDL.h>
 #include "common.h"
+#include "gpumem.h"
 
 SDL_GPUTexture *upload_texture(
         SDL_GPUDevice *gpu,
@@ -9,9 +10,29 @@ SDL_GPUTexture *upload_texture(
         const void *pixels,
         Uint32 pixels_byte_size,
         Uint32 width,
-        Uint32 height);
+        Uint32 height,
+        const char *name);
+
+void upload_texture_layer(
+        SDL_GPUDevice *gpu,
+        SDL_GPUCopyPass *copy_pass,
+        SDL_GPUTexture *texture,
+        Uint32 layer,
+        const void *pixels,
+        Uint32 pixels_byte_size,
+        Uint32 width,
+        Uint32 height,
+        const char *name);
 
 Mesh upload_mesh_bytes(SDL_GPUDevice *gpu, SDL_GPUCopyPass *copy_pass,
                        const void *vertex_bytes, Uint32 vertex_byte_size,
                        const void *index_bytes, Uint32 index_byte_size,
-                       size_t num_indices);
+                       size_t num_indices, const char *name);
+
+bool  transient_buffer_create(SDL_GPUDevice *gpu, TransientBuffer *tb, Uint32 capacity, SDL_GPUBufferUsageFlags usage);
+void  transient_buffer_release(SDL_GPUDevice *gpu, TransientBuffer *tb);
+void  transient_buffer_begin(SDL_GPUDevice *gpu, TransientBuffer *tb);
+void *transient_buffer_alloc(TransientBuffer *tb, Uint32 size, Uint32 align, Uint32 *offset);
+void  transient_buffer_upload(SDL_GPUDevice *gpu, TransientBuffer *tb, SDL_GPUCommandBuffer *cmd_buf);
+
+void set_render_area(SDL_GPURenderPass *render_pass, Uint32 width, Uint32 height);
@@ -0,0 +1,361 @@
+#include "gpucull.h"
+#include "game.h"
+#include "gpu.h"
+#include "pipeline.h"
+
+#define CULL_GROUP_SIZE 64
+#define HIZ_GROUP_SIZE 8
+
+// Level 0 is half the render size. Levels are reduced into the scratch
+// texture and copied over, the pyramid cannot be sampled and written in the
+// same pass.
+static bool hiz_create(AppState *app, Uint32 render_width, Uint32 render_height)
+{
+    GPUCull *cull = &app->gpu_cull;
+
+    Uint32 width = SDL_max((render_width + 1) / 2, 1);
+    Uint32 height = SDL_max((render_height + 1) / 2, 1);
+    Uint32 levels = 1;
+    while ((SDL_max(width, height) >> levels) > 0) levels++;
+
+    SDL_GPUTextureCreateInfo hiz_createinfo = {
+        .format = SDL_GPU_TEXTUREFORMAT_R32_FLOAT,
+        .usage = SDL_GPU_TEXTUREUSAGE_SAMPLER,
+        .width = width,
+        .height = height,
+        .layer_count_or_depth = 1,
+        .num_levels = levels,
+    };
+    SDL_GPUTexture *texture = gpumem_create_texture(app->gpu, &hiz_createinfo, GPU_MEM_RENDER_TARGET, "hiz pyramid");
+
+    SDL_GPUTextureCreateInfo scratch_createinfo = hiz_createinfo;
+    scratch_createinfo.usage = SDL_GPU_TEXTUREUSAGE_COMPUTE_STORAGE_WRITE;
+    scratch_createinfo.num_levels = 1;
+    SDL_GPUTexture *scratch = gpumem_create_texture(app->gpu, &scratch_createinfo, GPU_MEM_RENDER_TARGET, "hiz scratch");
+
+    if (!texture || !scratch) {
+        SDL_Log("Failed to create %ux%u hiz pyramid\n%s", width, height, SDL_GetError());
+        gpumem_release_texture(app->gpu, texture);
+        gpumem_release_texture(app->gpu, scratch);
+        return false;
+    }
+
+    // frames in flight keep the old ones until they are done
+    gpumem_release_texture(app->gpu, cull->hiz_texture);
+    gpumem_release_texture(app->gpu, cull->hiz_scratch);
+    cull->hiz_texture = texture;
+    cull->hiz_scratch = scratch;
+    cull->hiz_width = width;
+    cull->hiz_height = height;
+    cull->hiz_levels = levels;
+    return true;
+}
+
+// The pyramid is created even when hiz.comp is missing, cull.comp always
+// binds it and just skips the occlusion test.
+static bool hiz_init(AppState *app)
+{
+    GPUCull *cull = &app->gpu_cull;
+
+    SDL_GPUSamplerCreateInfo sampler_createinfo = {
+        .min_filter = SDL_GPU_FILTER_NEAREST,
+        .mag_filter = SDL_GPU_FILTER_NEAREST,
+        .mipmap_mode = SDL_GPU_SAMPLERMIPMAPMODE_NEAREST,
+        .address_mode_u = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE,
+        .address_mode_v = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE,
+        .address_mode_w = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE,
+        .max_lod = 1000,
+    };
+    cull->hiz_sampler = SDL_CreateGPUSampler(app->gpu, &sampler_createinfo);
+
+    if (!cull->hiz_sampler) {
+        SDL_Log("Failed to create hiz sampler\n%s", SDL_GetError());
+        return false;
+    }
+    if (!hiz_create(app, app->window_width, app->window_height)) return false;
+
+    cull->hiz_pipeline = LoadComputePipeline(app->gpu, &app->shader_pack, "hiz.comp");
+    if (!cull->hiz_pipeline) {
+        SDL_Log("Failed to load hiz compute pipeline, occlusion culling disabled\n%s", SDL_GetError());
+    }
+    return true;
+}
+
+bool gpu_cull_init(AppState *app)
+{
+    GPUCull *cull = &app->gpu_cull;
+
+    cull->cull_pipeline = LoadComputePipeline(app->gpu, &app->shader_pack, "cull.comp");
+    if (!cull->cull_pipeline) {
+        SDL_Log("Failed to load cull compute pipeline, gpu culling disabled\n%s", SDL_GetError());
+        return false;
+    }
+
+    PipelineDesc desc = pipeline_desc_default(app);
+    Uint32 features = SHADER_FEATURE_TEXTURED | SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_GPU_CULLED;
+    if (app->lights.cluster_pipeline) features |= SHADER_FEATURE_LIT;
+    shader_variant_name(desc.vertex_shader, sizeof(desc.vertex_shader), "shader.vert", features);
+    shader_variant_name(desc.fragment_shader, sizeof(desc.fragment_shader), "shader.frag", features);
+    cull->pipeline = pipeline_get(app, &desc);
+
+    SDL_GPUBufferCreateInfo draw_createinfo = {
+        .usage = SDL_GPU_BUFFERUSAGE_INDIRECT | SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_WRITE,
+        .size  = GPU_CULL_PHASE_COUNT * MAX_MODELS * sizeof(SDL_GPUIndexedIndirectDrawCommand),
+    };
+    cull->draw_buffer = gpumem_create_buffer(app->gpu, &draw_createinfo, GPU_MEM_STORAGE, "indirect draws");
+
+    if (!cull->pipeline || !cull->draw_buffer || !hiz_init(app)) {
+        SDL_Log("Failed to set up gpu culling\n%s", SDL_GetError());
+        gpu_cull_release(app);
+        return false;
+    }
+
+    return true;
+}
+
+// The pyramid maps onto the whole rendered area, so it follows the render
+// size whenever a resize or dynamic resolution changes it. Keeps the old
+// one and returns false when the new one can't be created.
+bool gpu_cull_resize(AppState *app, Uint32 render_width, Uint32 render_height)
+{
+    GPUCull *cull = &app->gpu_cull;
+    if (cull->hiz_width == SDL_max((render_width + 1) / 2, 1) &&
+        cull->hiz_height == SDL_max((render_height + 1) / 2, 1)) {
+        return true;
+    }
+    return hiz_create(app, render_width, render_height);
+}
+
+void gpu_cull_release(AppState *app)
+{
+    GPUCull *cull = &app->gpu_cull;
+
+    // the graphics pipeline belongs to the pipeline cache
+    SDL_ReleaseGPUComputePipeline(app->gpu, cull->cull_pipeline);
+    SDL_ReleaseGPUComputePipeline(app->gpu, cull->hiz_pipeline);
+    gpumem_release_buffer(app->gpu, cull->draw_buffer);
+    gpumem_release_buffer(app->gpu, cull->visible_buffer);
+    gpumem_release_buffer(app->gpu, cull->visibility_buffer);
+    gpumem_release_texture(app->gpu, cull->hiz_texture);
+    gpumem_release_texture(app->gpu, cull->hiz_scratch);
+    SDL_ReleaseGPUSampler(app->gpu, cull->hiz_sampler);
+    SDL_zerop(cull);
+}
+
+static bool ensure_visible_capacity(AppState *app, Uint32 count)
+{
+    GPUCull *cull = &app->gpu_cull;
+    if (cull->visible_buffer && cull->visible_capacity >= count) return true;
+
+    Uint32 capacity = SDL_max(cull->visible_capacity, 1024);
+    while (capacity < count) capacity *= 2;
+
+    SDL_GPUBufferCreateInfo visible_createinfo = {
+        .usage = SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_WRITE | SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ,
+        .size  = GPU_CULL_PHASE_COUNT * capacity * sizeof(Uint32),
+    };
+    SDL_GPUBuffer *visible = gpumem_create_buffer(app->gpu, &visible_createinfo, GPU_MEM_STORAGE, "visible instances");
+    SDL_GPUBufferCreateInfo visibility_createinfo = {
+        .usage = SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_READ | SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_WRITE,
+        .size  = capacity * sizeof(Uint32),
+    };
+    SDL_GPUBuffer *visibility = gpumem_create_buffer(app->gpu, &visibility_createinfo, GPU_MEM_STORAGE, "instance visibility");
+    if (!visible || !visibility) {
+        SDL_Log("Failed to grow visible instance buffers\n%s", SDL_GetError());
+        gpumem_release_buffer(app->gpu, visible);
+        gpumem_release_buffer(app->gpu, visibility);
+        return false;
+    }
+
+    gpumem_release_buffer(app->gpu, cull->visible_buffer);
+    gpumem_release_buffer(app->gpu, cull->visibility_buffer);
+    cull->visible_buffer = visible;
+    cull->visibility_buffer = visibility;
+    cull->visible_capacity = capacity;
+    cull->history = false;
+    return true;
+}
+
+// Writes per-draw list offsets and reset draw commands into frame_data.
+// Must be called between transient begin and upload, after instances_write.
+bool gpu_cull_write(AppState *app)
+{
+    GPUCull *cull = &app->gpu_cull;
+    const EntityStore *entities = &app->snapshot.entities;
+    Uint32 count = (Uint32) entities->count;
+
+    if (!ensure_visible_capacity(app, count)) return false;
+    // visibility is indexed by record, static records first, so it is
+    // stale once entities come or go
+    if (entities->version != cull->entity_version) cull->history = false;
+    cull->entity_version = entities->version;
+
+    SDL_memcpy(cull->draw_count, entities->model_count, sizeof(cull->draw_count));
+    Uint32 first = 0;
+    for (int m = 0; m < app->model_count; m++) {
+        cull->draw_first[m] = first;
+        first += cull->draw_count[m];
+    }
+
+    Uint32 first_offset;
+    Uint32 *draw_first = transient_buffer_alloc(&app->frame_data, MAX_MODELS * sizeof(Uint32),
+                                                sizeof(Uint32), &first_offset);
+    SDL_GPUIndexedIndirectDrawCommand *commands = transient_buffer_alloc(&app->frame_data,
+                                                                         GPU_CULL_PHASE_COUNT * MAX_MODELS * sizeof(*commands),
+                                                                         sizeof(Uint32), &cull->commands_offset);
+    if (!draw_first || !commands) return false;
+
+    for (int m = 0; m < MAX_MODELS; m++) {
+        draw_first[m] = cull->draw_first[m];
+        for (int phase = 0; phase < GPU_CULL_PHASE_COUNT; phase++) {
+            commands[phase * MAX_MODELS + m] = (SDL_GPUIndexedIndirectDrawCommand) {
+                .num_indices = m < app->model_count ? app->models[m].mesh.index_count : 0,
+            };
+        }
+    }
+
+    cull->draw_first_base = first_offset / sizeof(Uint32);
+    return true;
+}
+
+void gpu_cull_dispatch(AppState *app, SDL_GPUCommandBuffer *cmd_buf, const vec4 planes[6],
+                       const mat4 view_mat, const mat4 proj_mat, GPUCullPhase phase)
+{
+    GPUCull *cull = &app->gpu_cull;
+
+    // reset instance counts by copying the fresh commands over last frame's
+    if (phase == GPU_CULL_EARLY) {
+        SDL_GPUCopyPass *copy_pass = SDL_BeginGPUCopyPass(cmd_buf);
+        SDL_GPUBufferLocation src = {
+            .buffer = app->frame_data.buffer,
+            .offset = cull->commands_offset,
+        };
+        SDL_GPUBufferLocation dst = {
+            .buffer = cull->draw_buffer,
+        };
+        SDL_CopyGPUBufferToBuffer(copy_pass, &src, &dst,
+                                  GPU_CULL_PHASE_COUNT * MAX_MODELS * sizeof(SDL_GPUIndexedIndirectDrawCommand), true);
+        SDL_EndGPUCopyPass(copy_pass);
+    }
+
+    // the commands were reset by the copy above and the visibility carries
+    // over between frames, only the visible list is rewritten from scratch
+    SDL_GPUStorageBufferReadWriteBinding rw_bindings[] = {
+        { .buffer = cull->draw_buffer, .cycle = false },
+        { .buffer = cull->visible_buffer, .cycle = true },
+        { .buffer = cull->visibility_buffer, .cycle = false },
+    };
+    SDL_GPUComputePass *compute_pass = SDL_BeginGPUComputePass(cmd_buf, NULL, 0, rw_bindings, SDL_arraysize(rw_bindings));
+
+    CullUniforms uniforms = {
+        .proj_x = proj_mat[0][0],
+        .proj_y = proj_mat[1][1],
+        .znear = CAMERA_NEAR,
+        .zfar = CAMERA_FAR,
+        .instance_count = app->instances.count,
+        .instance_base = 0,
+        .draw_first_base = cull->draw_first_base,
+        .phase = phase,
+        .draw_base = phase * MAX_MODELS,
+        .visible_base = phase * cull->visible_capacity,
+        .history = cull->history,
+        .occlusion = cull->hiz_pipeline != NULL,
+    };
+    SDL_memcpy(uniforms.planes, planes, sizeof(uniforms.planes));
+    mat4_copy(view_mat, uniforms.view);
+    SDL_PushGPUComputeUniformData(cmd_buf, 0, &uniforms, sizeof(uniforms));
+
+    SDL_BindGPUComputePipeline(compute_pass, cull->cull_pipeline);
+    SDL_GPUTextureSamplerBinding hiz_binding = {
+        .texture = cull->hiz_texture,
+        .sampler = cull->hiz_sampler,
+    };
+    SDL_BindGPUComputeSamplers(compute_pass, 0, &hiz_binding, 1);
+    SDL_GPUBuffer *ro_buffers[] = { app->instances.buffer, app->frame_data.buffer };
+    SDL_BindGPUComputeStorageBuffers(compute_pass, 0, ro_buffers, SDL_arraysize(ro_buffers));
+    SDL_DispatchGPUCompute(compute_pass, (app->instances.count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    SDL_EndGPUComputePass(compute_pass);
+
+    if (phase == GPU_CULL_LATE) {
+        cull->history = true;
+    }
+}
+
+// Reduces the depth of the early draws into the pyramid, one level per
+// compute pass, each level read back from the previous one. Level 0 covers
+// only the width x height corner of the depth texture that was rendered to.
+void gpu_cull_build_hiz(AppState *app, SDL_GPUCommandBuffer *cmd_buf, SDL_GPUTexture *depth_texture,
+                        Uint32 width, Uint32 height)
+{
+    GPUCull *cull = &app->gpu_cull;
+    if (!cull->hiz_pipeline) return;
+
+    for (Uint32 level = 0; level < cull->hiz_levels; level++) {
+        HiZUniforms uniforms = {
+            .src_width = level == 0 ? width : SDL_max(cull->hiz_width >> (level - 1), 1),
+            .src_height = level == 0 ? height : SDL_max(cull->hiz_height >> (level - 1), 1),
+            .dst_width = SDL_max(cull->hiz_width >> level, 1),
+            .dst_height = SDL_max(cull->hiz_height >> level, 1),
+            .src_level = level == 0 ? 0 : level - 1,
+        };
+
+        SDL_GPUStorageTextureReadWriteBinding rw_binding = {
+            .texture = cull->hiz_scratch,
+            .cycle = true,
+        };
+        SDL_GPUComputePass *compute_pass = SDL_BeginGPUComputePass(cmd_buf, &rw_binding, 1, NULL, 0);
+        SDL_BindGPUComputePipeline(compute_pass, cull->hiz_pipeline);
+        SDL_GPUTextureSamplerBinding src_binding = {
+            .texture = level == 0 ? depth_texture : cull->hiz_texture,
+            .sampler = cull->hiz_sampler,
+        };
+        SDL_BindGPUComputeSamplers(compute_pass, 0, &src_binding, 1);
+        SDL_PushGPUComputeUniformData(cmd_buf, 0, &uniforms, sizeof(uniforms));
+        SDL_DispatchGPUCompute(compute_pass,
+                               (uniforms.dst_width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+                               (uniforms.dst_height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+        SDL_EndGPUComputePass(compute_pass);
+
+        SDL_GPUCopyPass *copy_pass = SDL_BeginGPUCopyPass(cmd_buf);
+        SDL_GPUTextureLocation src = {
+            .texture = cull->hiz_scratch,
+        };
+        SDL_GPUTextureLocation dst = {
+            .texture = cull->hiz_texture,
+            .mip_level = level,
+        };
+        SDL_CopyGPUTextureToTexture(copy_pass, &src, &dst, uniforms.dst_width, uniforms.dst_height, 1, false);
+        SDL_EndGPUCopyPass(copy_pass);
+    }
+}
+
+void gpu_cull_draw(AppState *app, SDL_GPURenderPass *render_pass, SDL_GPUCommandBuffer *cmd_buf, GPUCullPhase phase)
+{
+    GPUCull *cull = &app->gpu_cull;
+
+    SDL_GPUBuffer *storage_buffers[] = { app->instances.buffer, cull->visible_buffer };
+    SDL_BindGPUGraphicsPipeline(render_pass, cull->pipeline);
+    SDL_BindGPUVertexStorageBuffers(render_pass, 0, storage_buffers, SDL_arraysize(storage_buffers));
+
+    for (int m = 0; m < app->model_count; m++) {
+        if (cull->draw_count[m] == 0) continue;
+
+        DrawUniforms draw = {
+            .instance_offset = phase * cull->visible_capacity + cull->draw_first[m],
+        };
+        SDL_PushGPUVertexUniformData(cmd_buf, 1, &draw, sizeof(draw));
+
+        const Model *model = &app->models[m];
+        SDL_GPUBufferBinding vert_bindings = {
+            .buffer = model->mesh.vertex_buffer,
+        };
+        SDL_BindGPUVertexBuffers(render_pass, 0, &vert_bindings, 1);
+        SDL_GPUBufferBinding index_bindings = {
+            .buffer = model->mesh.index_buffer,
+        };
+        SDL_BindGPUIndexBuffer(render_pass, &index_bindings, SDL_GPU_INDEXELEMENTSIZE_16BIT);
+        SDL_DrawGPUIndexedPrimitivesIndirect(render_pass, cull->draw_buffer,
+                                             (phase * MAX_MODELS + (Uint32) m) * sizeof(SDL_GPUIndexedIndirectDrawCommand), 1);
+    }
+}
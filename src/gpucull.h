@@ -0,0 +1,15 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "common.h"
+
+bool gpu_cull_init(AppState *app);
+void gpu_cull_release(AppState *app);
+bool gpu_cull_resize(AppState *app, Uint32 render_width, Uint32 render_height);
+
+bool gpu_cull_write(AppState *app);
+void gpu_cull_dispatch(AppState *app, SDL_GPUCommandBuffer *cmd_buf, const vec4 planes[6],
+                       const mat4 view_mat, const mat4 proj_mat, GPUCullPhase phase);
+void gpu_cull_build_hiz(AppState *app, SDL_GPUCommandBuffer *cmd_buf, SDL_GPUTexture *depth_texture,
+                        Uint32 width, Uint32 height);
+void gpu_cull_draw(AppState *app, SDL_GPURenderPass *render_pass, SDL_GPUCommandBuffer *cmd_buf, GPUCullPhase phase);
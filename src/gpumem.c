@@ -0,0 +1,235 @@
+#include "gpumem.h"
+
+// Every buffer and texture is recorded here with its estimated size so we
+// can keep an eye on vram. Sizes are what we asked for: driver padding,
+// alignment and the extra copies made by cycling are not visible to us.
+
+#define GPU_MEM_OWNER_LEN 48
+
+typedef struct {
+    const void *handle;
+    Uint64 size;
+    GPUMemCategory category;
+    char owner[GPU_MEM_OWNER_LEN];
+} GPUMemRecord;
+
+static struct {
+    SDL_SpinLock lock;
+    GPUMemRecord *records;
+    Uint32 count;
+    Uint32 capacity;
+    GPUMemStats stats;
+    Uint64 budget;
+    bool over_budget;
+} tracker;
+
+static const char *category_names[GPU_MEM_CATEGORY_COUNT] = {
+    [GPU_MEM_VERTEX]        = "vertex",
+    [GPU_MEM_INDEX]         = "index",
+    [GPU_MEM_STORAGE]       = "storage",
+    [GPU_MEM_TEXTURE]       = "texture",
+    [GPU_MEM_RENDER_TARGET] = "render target",
+    [GPU_MEM_STAGING]       = "staging",
+};
+
+static void track(const void *handle, Uint64 size, GPUMemCategory category, const char *owner)
+{
+    if (!handle) return;
+
+    SDL_LockSpinlock(&tracker.lock);
+
+    if (tracker.count == tracker.capacity) {
+        Uint32 capacity = tracker.capacity ? tracker.capacity * 2 : 64;
+        GPUMemRecord *records = SDL_realloc(tracker.records, capacity * sizeof *records);
+        if (!records) {
+            SDL_UnlockSpinlock(&tracker.lock);
+            SDL_Log("Failed to grow gpu memory tracker");
+            return;
+        }
+        tracker.records = records;
+        tracker.capacity = capacity;
+    }
+
+    GPUMemRecord *record = &tracker.records[tracker.count++];
+    record->handle = handle;
+    record->size = size;
+    record->category = category;
+    SDL_strlcpy(record->owner, owner ? owner : "?", sizeof(record->owner));
+
+    GPUMemStats *stats = &tracker.stats;
+    stats->current[category] += size;
+    stats->peak[category] = SDL_max(stats->peak[category], stats->current[category]);
+    stats->total += size;
+    stats->total_peak = SDL_max(stats->total_peak, stats->total);
+    stats->allocation_count = tracker.count;
+
+    bool crossed = tracker.budget && !tracker.over_budget && stats->total > tracker.budget;
+    if (crossed) tracker.over_budget = true;
+    Uint64 total = stats->total;
+
+    SDL_UnlockSpinlock(&tracker.lock);
+
+    if (crossed) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_GPU, "gpu memory budget exceeded: %.2f MiB used of %.2f MiB (last: %s)",
+                    (double)total / (1024.0 * 1024.0), (double)tracker.budget / (1024.0 * 1024.0), owner);
+    }
+}
+
+static void untrack(const void *handle)
+{
+    if (!handle) return;
+
+    SDL_LockSpinlock(&tracker.lock);
+
+    for (Uint32 i = 0; i < tracker.count; i++) {
+        GPUMemRecord *record = &tracker.records[i];
+        if (record->handle != handle) continue;
+
+        tracker.stats.current[record->category] -= record->size;
+        tracker.stats.total -= record->size;
+        if (tracker.budget && tracker.stats.total <= tracker.budget) {
+            tracker.over_budget = false;
+        }
+
+        *record = tracker.records[--tracker.count];
+        tracker.stats.allocation_count = tracker.count;
+        break;
+    }
+
+    SDL_UnlockSpinlock(&tracker.lock);
+}
+
+static Uint64 texture_byte_size(const SDL_GPUTextureCreateInfo *createinfo)
+{
+    Uint32 width  = createinfo->width;
+    Uint32 height = createinfo->height;
+    Uint32 depth  = createinfo->type == SDL_GPU_TEXTURETYPE_3D ? createinfo->layer_count_or_depth : 1;
+    Uint32 layers = createinfo->type == SDL_GPU_TEXTURETYPE_3D ? 1 : createinfo->layer_count_or_depth;
+    Uint32 levels = SDL_max(createinfo->num_levels, 1);
+
+    Uint64 size = 0;
+    for (Uint32 level = 0; level < levels; level++) {
+        size += SDL_CalculateGPUTextureFormatSize(createinfo->format, width, height, depth);
+        width  = SDL_max(width / 2, 1);
+        height = SDL_max(height / 2, 1);
+        depth  = SDL_max(depth / 2, 1);
+    }
+
+    return size * SDL_max(layers, 1) * (1u << createinfo->sample_count);
+}
+
+SDL_GPUBuffer *gpumem_create_buffer(SDL_GPUDevice *gpu, const SDL_GPUBufferCreateInfo *createinfo,
+                                    GPUMemCategory category, const char *owner)
+{
+    SDL_GPUBuffer *buffer = SDL_CreateGPUBuffer(gpu, createinfo);
+    if (buffer && owner) {
+        SDL_SetGPUBufferName(gpu, buffer, owner);
+    }
+    track(buffer, createinfo->size, category, owner);
+    return buffer;
+}
+
+SDL_GPUTexture *gpumem_create_texture(SDL_GPUDevice *gpu, const SDL_GPUTextureCreateInfo *createinfo,
+                                      GPUMemCategory category, const char *owner)
+{
+    SDL_GPUTexture *texture = SDL_CreateGPUTexture(gpu, createinfo);
+    if (texture && owner) {
+        SDL_SetGPUTextureName(gpu, texture, owner);
+    }
+    track(texture, texture_byte_size(createinfo), category, owner);
+    return texture;
+}
+
+SDL_GPUTransferBuffer *gpumem_create_transfer_buffer(SDL_GPUDevice *gpu, const SDL_GPUTransferBufferCreateInfo *createinfo,
+                                                     const char *owner)
+{
+    SDL_GPUTransferBuffer *transfer_buffer = SDL_CreateGPUTransferBuffer(gpu, createinfo);
+    track(transfer_buffer, createinfo->size, GPU_MEM_STAGING, owner);
+    return transfer_buffer;
+}
+
+void gpumem_release_buffer(SDL_GPUDevice *gpu, SDL_GPUBuffer *buffer)
+{
+    untrack(buffer);
+    SDL_ReleaseGPUBuffer(gpu, buffer);
+}
+
+void gpumem_release_texture(SDL_GPUDevice *gpu, SDL_GPUTexture *texture)
+{
+    untrack(texture);
+    SDL_ReleaseGPUTexture(gpu, texture);
+}
+
+void gpumem_release_transfer_buffer(SDL_GPUDevice *gpu, SDL_GPUTransferBuffer *transfer_buffer)
+{
+    untrack(transfer_buffer);
+    SDL_ReleaseGPUTransferBuffer(gpu, transfer_buffer);
+}
+
+void gpumem_set_budget(Uint64 budget_bytes)
+{
+    SDL_LockSpinlock(&tracker.lock);
+    tracker.budget = budget_bytes;
+    tracker.over_budget = budget_bytes && tracker.stats.total > budget_bytes;
+    SDL_UnlockSpinlock(&tracker.lock);
+}
+
+GPUMemStats gpumem_stats(void)
+{
+    SDL_LockSpinlock(&tracker.lock);
+    GPUMemStats stats = tracker.stats;
+    SDL_UnlockSpinlock(&tracker.lock);
+    return stats;
+}
+
+#define MIB(bytes) ((double)(bytes) / (1024.0 * 1024.0))
+
+void gpumem_report(int top_n)
+{
+    SDL_LockSpinlock(&tracker.lock);
+
+    GPUMemStats *stats = &tracker.stats;
+    SDL_Log("gpu memory: %.2f MiB in %u allocations (peak %.2f MiB)",
+            MIB(stats->total), stats->allocation_count, MIB(stats->total_peak));
+    if (tracker.budget) {
+        SDL_Log("  budget %.2f MiB (%.1f%% used)", MIB(tracker.budget),
+                100.0 * (double)stats->total / (double)tracker.budget);
+    }
+    for (int c = 0; c < GPU_MEM_CATEGORY_COUNT; c++) {
+        SDL_Log("  %-14s %8.2f MiB (peak %.2f MiB)", category_names[c], MIB(stats->current[c]), MIB(stats->peak[c]));
+    }
+
+    // partial selection sort, the record count stays small
+    top_n = SDL_min(top_n, (int) tracker.count);
+    for (int i = 0; i < top_n; i++) {
+        Uint32 largest = (Uint32) i;
+        for (Uint32 j = (Uint32) i + 1; j < tracker.count; j++) {
+            if (tracker.records[j].size > tracker.records[largest].size) largest = j;
+        }
+        GPUMemRecord tmp = tracker.records[i];
+        tracker.records[i] = tracker.records[largest];
+        tracker.records[largest] = tmp;
+
+        const GPUMemRecord *record = &tracker.records[i];
+        SDL_Log("  #%d %-32s %-14s %8.2f MiB", i + 1, record->owner, category_names[record->category], MIB(record->size));
+    }
+
+    SDL_UnlockSpinlock(&tracker.lock);
+}
+
+void gpumem_report_leaks(void)
+{
+    SDL_LockSpinlock(&tracker.lock);
+
+    for (Uint32 i = 0; i < tracker.count; i++) {
+        const GPUMemRecord *record = &tracker.records[i];
+        SDL_LogWarn(SDL_LOG_CATEGORY_GPU, "gpu memory leak: %s (%s, %" SDL_PRIu64 " bytes)",
+                    record->owner, category_names[record->category], record->size);
+    }
+
+    SDL_free(tracker.records);
+    tracker.records = NULL;
+    tracker.count = tracker.capacity = 0;
+
+    SDL_UnlockSpinlock(&tracker.lock);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+typedef enum {
+    GPU_MEM_VERTEX,
+    GPU_MEM_INDEX,
+    GPU_MEM_STORAGE,
+    GPU_MEM_TEXTURE,
+    GPU_MEM_RENDER_TARGET,
+    GPU_MEM_STAGING,
+    GPU_MEM_CATEGORY_COUNT
+} GPUMemCategory;
+
+typedef struct {
+    Uint64 current[GPU_MEM_CATEGORY_COUNT];
+    Uint64 peak[GPU_MEM_CATEGORY_COUNT];
+    Uint64 total;
+    Uint64 total_peak;
+    Uint32 allocation_count;
+} GPUMemStats;
+
+SDL_GPUBuffer *gpumem_create_buffer(SDL_GPUDevice *gpu, const SDL_GPUBufferCreateInfo *createinfo,
+                                    GPUMemCategory category, const char *owner);
+SDL_GPUTexture *gpumem_create_texture(SDL_GPUDevice *gpu, const SDL_GPUTextureCreateInfo *createinfo,
+                                      GPUMemCategory category, const char *owner);
+SDL_GPUTransferBuffer *gpumem_create_transfer_buffer(SDL_GPUDevice *gpu, const SDL_GPUTransferBufferCreateInfo *createinfo,
+                                                     const char *owner);
+
+void gpumem_release_buffer(SDL_GPUDevice *gpu, SDL_GPUBuffer *buffer);
+void gpumem_release_texture(SDL_GPUDevice *gpu, SDL_GPUTexture *texture);
+void gpumem_release_transfer_buffer(SDL_GPUDevice *gpu, SDL_GPUTransferBuffer *transfer_buffer);
+
+void gpumem_set_budget(Uint64 budget_bytes);
+GPUMemStats gpumem_stats(void);
+void gpumem_report(int top_n);
+void gpumem_report_leaks(void);
@@ -0,0 +1,120 @@
+#include "instances.h"
+#include "game.h"
+#include "gpu.h"
+#include "entity.h"
+
+void instances_release(AppState *app)
+{
+    InstanceBuffer *instances = &app->instances;
+    gpumem_release_buffer(app->gpu, instances->buffer);
+    SDL_zerop(instances);
+}
+
+// A new buffer starts without any records
+static bool ensure_capacity(AppState *app, Uint32 count)
+{
+    InstanceBuffer *instances = &app->instances;
+    if (instances->buffer && instances->capacity >= count) return true;
+
+    Uint32 capacity = SDL_max(instances->capacity, 1024);
+    while (capacity < count) capacity *= 2;
+
+    SDL_GPUBufferCreateInfo createinfo = {
+        .usage = SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_READ | SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ,
+        .size  = capacity * sizeof(GPUInstance),
+    };
+    SDL_GPUBuffer *buffer = gpumem_create_buffer(app->gpu, &createinfo, GPU_MEM_STORAGE, "instances");
+    if (!buffer) {
+        SDL_Log("Failed to grow instance buffer\n%s", SDL_GetError());
+        return false;
+    }
+
+    gpumem_release_buffer(app->gpu, instances->buffer);
+    instances->buffer = buffer;
+    instances->capacity = capacity;
+    instances->valid = false;
+    return true;
+}
+
+static void write_instance(AppState *app, const EntityStore *entities, int i, GPUInstance *instance)
+{
+    const Mesh *mesh = &app->models[entities->model_id[i]].mesh;
+    SDL_memcpy(instance->model, entities->world[i], sizeof(mat3x4));
+    mat3x4_mulv3(instance->model, mesh->center, instance->sphere);
+    instance->sphere[3] = mesh->radius;
+    instance->draw = (Uint32) entities->model_id[i];
+    instance->material = entities->material[i];
+}
+
+// Writes the records the snapshot changed since the last upload into
+// frame_data, every record when the buffer has none yet. Must be called
+// between transient begin and upload.
+bool instances_write(AppState *app)
+{
+    InstanceBuffer *instances = &app->instances;
+    EntityStore *entities = &app->snapshot.entities;
+    Uint32 count = (Uint32) entities->count;
+
+    instances->upload_full = false;
+    instances->upload_count = 0;
+    if (!ensure_capacity(app, count)) return false;
+
+    Uint32 first = 0;
+    Uint32 end = count;
+    if (instances->valid) {
+        first = (Uint32) entities->changed_first;
+        end = SDL_min((Uint32) entities->changed_end, count);
+    }
+    Uint32 upload_count = end > first ? end - first : 0;
+
+    if (upload_count > 0) {
+        GPUInstance *records = transient_buffer_alloc(&app->frame_data, upload_count * sizeof(GPUInstance),
+                                                      sizeof(GPUInstance), &instances->upload_offset);
+        if (!records) return false;
+        for (Uint32 i = first; i < end; i++) {
+            write_instance(app, entities, (int) i, &records[i - first]);
+        }
+    }
+    entity_store_clear_changes(entities);
+
+    instances->count = count;
+    instances->upload_full = !instances->valid;
+    instances->upload_first = first;
+    instances->upload_count = upload_count;
+    return true;
+}
+
+// Copies this frame's records into the persistent buffer. Record after
+// transient_buffer_upload and before anything that reads the records.
+void instances_upload(AppState *app, SDL_GPUCommandBuffer *cmd_buf)
+{
+    InstanceBuffer *instances = &app->instances;
+
+    // no cycling, that would drop the static records
+    if (instances->upload_count > 0) {
+        SDL_GPUCopyPass *copy_pass = SDL_BeginGPUCopyPass(cmd_buf);
+        SDL_GPUBufferLocation src = {
+            .buffer = app->frame_data.buffer,
+            .offset = instances->upload_offset,
+        };
+        SDL_GPUBufferLocation dst = {
+            .buffer = instances->buffer,
+            .offset = instances->upload_first * sizeof(GPUInstance),
+        };
+        SDL_CopyGPUBufferToBuffer(copy_pass, &src, &dst, instances->upload_count * sizeof(GPUInstance), false);
+        SDL_EndGPUCopyPass(copy_pass);
+    }
+
+    if (instances->upload_full) {
+        instances->valid = true;
+        instances->stats.full_uploads++;
+    }
+    instances->stats.uploaded = instances->upload_count;
+}
+
+// Record index of a dense entity of the snapshot, valid after instances_write
+Uint32 instance_record(const AppState *app, int entity)
+{
+    (void) app;
+    return (Uint32) entity;
+}
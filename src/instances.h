@@ -0,0 +1,10 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "common.h"
+
+void instances_release(AppState *app);
+
+bool instances_write(AppState *app);
+void instances_upload(AppState *app, SDL_GPUCommandBuffer *cmd_buf);
+Uint32 instance_record(const AppState *app, int entity);
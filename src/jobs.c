@@ -0,0 +1,114 @@
+#include "jobs.h"
+
+// Pulls indices of the current batch until none are left. Called with the
+// lock held, returns with the lock held.
+static void run_batch(JobPool *pool)
+{
+    while (pool->next < pool->count) {
+        int index = pool->next++;
+        JobFunc func = pool->func;
+        void *userdata = pool->userdata;
+
+        SDL_UnlockMutex(pool->lock);
+        func(userdata, index);
+        SDL_LockMutex(pool->lock);
+
+        if (--pool->remaining == 0) {
+            SDL_BroadcastCondition(pool->done);
+        }
+    }
+}
+
+static int worker_main(void *data)
+{
+    JobPool *pool = data;
+    Uint32 seen = 0;
+
+    SDL_LockMutex(pool->lock);
+    for (;;) {
+        while (!pool->quit && pool->generation == seen) {
+            SDL_WaitCondition(pool->wake, pool->lock);
+        }
+        if (pool->quit) break;
+
+        seen = pool->generation;
+        run_batch(pool);
+    }
+    SDL_UnlockMutex(pool->lock);
+
+    return 0;
+}
+
+bool jobs_init(JobPool *pool, int worker_count)
+{
+    SDL_zerop(pool);
+
+    pool->lock = SDL_CreateMutex();
+    pool->wake = SDL_CreateCondition();
+    pool->done = SDL_CreateCondition();
+    if (!pool->lock || !pool->wake || !pool->done) {
+        SDL_Log("Failed to create job pool\n%s", SDL_GetError());
+        jobs_shutdown(pool);
+        return false;
+    }
+
+    worker_count = SDL_clamp(worker_count, 0, MAX_WORKERS);
+    for (int i = 0; i < worker_count; i++) {
+        char name[16];
+        SDL_snprintf(name, sizeof(name), "worker %d", i);
+        pool->threads[i] = SDL_CreateThread(worker_main, name, pool);
+        if (!pool->threads[i]) {
+            SDL_Log("Failed to create worker thread\n%s", SDL_GetError());
+            break;
+        }
+        pool->worker_count++;
+    }
+
+    return true;
+}
+
+void jobs_shutdown(JobPool *pool)
+{
+    if (pool->lock) {
+        SDL_LockMutex(pool->lock);
+        pool->quit = true;
+        SDL_BroadcastCondition(pool->wake);
+        SDL_UnlockMutex(pool->lock);
+    }
+
+    for (int i = 0; i < pool->worker_count; i++) {
+        SDL_WaitThread(pool->threads[i], NULL);
+    }
+
+    SDL_DestroyCondition(pool->done);
+    SDL_DestroyCondition(pool->wake);
+    SDL_DestroyMutex(pool->lock);
+    SDL_zerop(pool);
+}
+
+void jobs_parallel_for(JobPool *pool, JobFunc func, void *userdata, int count)
+{
+    if (count <= 0) return;
+
+    if (!pool->lock) {
+        for (int i = 0; i < count; i++) func(userdata, i);
+        return;
+    }
+
+    SDL_LockMutex(pool->lock);
+
+    pool->func = func;
+    pool->userdata = userdata;
+    pool->count = count;
+    pool->next = 0;
+    pool->remaining = count;
+    pool->generation++;
+    SDL_BroadcastCondition(pool->wake);
+
+    run_batch(pool);
+    while (pool->remaining > 0) {
+        SDL_WaitCondition(pool->done, pool->lock);
+    }
+
+    SDL_UnlockMutex(pool->lock);
+}
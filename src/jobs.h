@@ -0,0 +1,30 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+#define MAX_WORKERS 8
+
+typedef void (*JobFunc)(void *userdata, int index);
+
+// Persistent worker threads that run parallel-for batches. The calling
+// thread helps out, so a pool with zero workers still runs everything.
+typedef struct {
+    SDL_Thread *threads[MAX_WORKERS];
+    int worker_count;
+
+    SDL_Mutex *lock;
+    SDL_Condition *wake;
+    SDL_Condition *done;
+
+    JobFunc func;
+    void *userdata;
+    int count;
+    int next;
+    int remaining;
+    Uint32 generation;
+    bool quit;
+} JobPool;
+
+bool jobs_init(JobPool *pool, int worker_count);
+void jobs_shutdown(JobPool *pool);
+void jobs_parallel_for(JobPool *pool, JobFunc func, void *userdata, int count);
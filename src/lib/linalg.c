@@ -176,6 +176,19 @@ void quat_copy(const quat q, quat dest)
     vec4_copy(q, dest);
 }
 
+// v' = v + 2w(u x v) + 2u x (u x v), u = q.xyz
+void quat_rotatev(const quat q, const vec3 v, vec3 dest)
+{
+    vec3 u = { q[0], q[1], q[2] };
+    vec3 uv, uuv;
+    vec3_cross(u, v, uv);
+    vec3_cross(u, uv, uuv);
+    vec3_scale(uv, 2.0f * q[3], uv);
+    vec3_scale(uuv, 2.0f, uuv);
+    vec3_add(v, uv, dest);
+    vec3_add(dest, uuv, dest);
+}
+
 void mat4_copy(const mat4 mat, mat4 dest)
 {
     dest[0][0] = mat[0][0];  dest[1][0] = mat[1][0];
@@ -317,18 +330,65 @@ void mat4_from_quat(const quat q, mat4 m)
     m[3][3] = 1.0f;
 }
 
-void mat4_from_trs(const vec3 t, const quat r, const vec3 s, mat4 dest)
+// translation * rotation * scale built directly as rows, no matrix products
+void mat3x4_from_trs(const vec3 t, const quat r, const vec3 s, mat3x4 dest)
 {
-    mat4 translation, rotation, scale;
-    mat4_translate(t, translation);
-    mat4_from_quat(r, rotation);
-    mat4_scale(s, scale);
-    mat4 *matrices[3] = {
-        &scale,
-        &rotation,
-        &translation,
-    };
-    mat4_mulN(matrices, 3, dest);
+    float
+        qxx = r[0] * r[0],
+        qyy = r[1] * r[1],
+        qzz = r[2] * r[2],
+        qxz = r[0] * r[2],
+        qxy = r[0] * r[1],
+        qyz = r[1] * r[2],
+        qwx = r[3] * r[0],
+        qwy = r[3] * r[1],
+        qwz = r[3] * r[2];
+
+    dest[0][0] = (1.0f - 2.0f * (qyy + qzz)) * s[0];
+    dest[0][1] = 2.0f * (qxy - qwz) * s[1];
+    dest[0][2] = 2.0f * (qxz + qwy) * s[2];
+    dest[0][3] = t[0];
+
+    dest[1][0] = 2.0f * (qxy + qwz) * s[0];
+    dest[1][1] = (1.0f - 2.0f * (qxx + qzz)) * s[1];
+    dest[1][2] = 2.0f * (qyz - qwx) * s[2];
+    dest[1][3] = t[1];
+
+    dest[2][0] = 2.0f * (qxz - qwy) * s[0];
+    dest[2][1] = 2.0f * (qyz + qwx) * s[1];
+    dest[2][2] = (1.0f - 2.0f * (qxx + qyy)) * s[2];
+    dest[2][3] = t[2];
+}
+
+// transforms a point
+void mat3x4_mulv3(const mat3x4 m, const vec3 v, vec3 dest)
+{
+    float x = v[0], y = v[1], z = v[2];
+    dest[0] = m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3];
+    dest[1] = m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3];
+    dest[2] = m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3];
+}
+
+// transforms a direction, ignoring the translation
+void mat3x4_mulv3_dir(const mat3x4 m, const vec3 v, vec3 dest)
+{
+    float x = v[0], y = v[1], z = v[2];
+    dest[0] = m[0][0] * x + m[0][1] * y + m[0][2] * z;
+    dest[1] = m[1][0] * x + m[1][1] * y + m[1][2] * z;
+    dest[2] = m[2][0] * x + m[2][1] * y + m[2][2] * z;
+}
+
+// m1 * m2 as affine transforms, the implicit last row is 0 0 0 1
+void mat3x4_mul(const mat3x4 m1, const mat3x4 m2, mat3x4 dest)
+{
+    mat3x4 r;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            r[i][j] = m1[i][0] * m2[0][j] + m1[i][1] * m2[1][j] + m1[i][2] * m2[2][j];
+        }
+        r[i][3] += m1[i][3];
+    }
+    SDL_memcpy(dest, r, sizeof(mat3x4));
 }
 
 // left-handed coordinate system: positive Z goes into the screen
@@ -349,6 +409,25 @@ void perspective_lh_zo(float fovy, float aspect, float nearZ, float farZ, mat4 d
     dest[3][2] = nearZ * farZ * fn;
 }
 
+void ortho_lh_zo(float left, float right, float bottom, float top, float nearZ, float farZ, mat4 dest)
+{
+    float rl, tb, fn;
+
+    mat4_zero(dest);
+
+    rl = 1.0f / (right - left);
+    tb = 1.0f / (top - bottom);
+    fn = 1.0f / (farZ - nearZ);
+
+    dest[0][0] = 2.0f * rl;
+    dest[1][1] = 2.0f * tb;
+    dest[2][2] = fn;
+    dest[3][0] = -(right + left) * rl;
+    dest[3][1] = -(top + bottom) * tb;
+    dest[3][2] = -nearZ * fn;
+    dest[3][3] = 1.0f;
+}
+
 void lookat_lh(const vec3 eye, const vec3 center, const vec3 up, mat4 dest)
 {
     ALIGN(16) vec3 f, u, s;
@@ -404,3 +483,30 @@ void euler_xyz(const vec3 angles, mat4 dest)
     dest[3][2] =  0.0f;
     dest[3][3] =  1.0f;
 }
+
+// Gribb/Hartmann plane extraction for a zero-to-one depth range.
+// Order: left, right, bottom, top, near, far. Planes point inwards and are
+// normalized, so dot(plane.xyz, p) + plane.w is a signed distance.
+void mat4_frustum_planes(const mat4 m, vec4 dest[6])
+{
+    for (int i = 0; i < 4; i++) {
+        float r0 = m[i][0], r1 = m[i][1], r2 = m[i][2], r3 = m[i][3];
+        dest[0][i] = r3 + r0;
+        dest[1][i] = r3 - r0;
+        dest[2][i] = r3 + r1;
+        dest[3][i] = r3 - r1;
+        dest[4][i] = r2;
+        dest[5][i] = r3 - r2;
+    }
+
+    for (int p = 0; p < 6; p++) {
+        float len = SDL_sqrtf(dest[p][0] * dest[p][0] + dest[p][1] * dest[p][1] + dest[p][2] * dest[p][2]);
+        if (len > SDL_FLT_EPSILON) {
+            float inv = 1.0f / len;
+            dest[p][0] *= inv;
+            dest[p][1] *= inv;
+            dest[p][2] *= inv;
+            dest[p][3] *= inv;
+        }
+    }
+}
@@ -21,6 +21,8 @@ typedef float           vec3[3];
 typedef ALIGN(16) float vec4[4];
 typedef vec4            quat;
 typedef ALIGN(16) vec4  mat4[4];
+// rows of an affine transform, the fourth row is implied 0 0 0 1
+typedef ALIGN(16) vec4  mat3x4[3];
 
 #define VEC2_ONE_INIT   {1.0f, 1.0f}
 #define VEC2_ZERO_INIT  {0.0f, 0.0f}
@@ -84,6 +86,7 @@ void quat_angle_axis(float angle_radians, const vec3 axis, quat dest);
 void quat_mul(const quat p, const quat q, quat dest);
 void vec4_copy(const vec4 v, vec4 dest);
 void quat_copy(const quat q, quat dest);
+void quat_rotatev(const quat q, const vec3 v, vec3 dest);
 
 void mat4_scale(const vec3 v, mat4 dest);
 void mat4_mulv3(const mat4 m, const vec3 v, float last, vec3 dest);
@@ -95,8 +98,13 @@ void mat4_mulN(mat4 * __restrict matrices[], uint32_t len, mat4 dest);
 
 void mat4_translate(const vec3 v, mat4 m);
 void mat4_from_quat(const quat q, mat4 m);
-void mat4_from_trs(const vec3 t, const quat r, const vec3 s, mat4 dest);
+void mat3x4_from_trs(const vec3 t, const quat r, const vec3 s, mat3x4 dest);
+void mat3x4_mulv3(const mat3x4 m, const vec3 v, vec3 dest);
+void mat3x4_mulv3_dir(const mat3x4 m, const vec3 v, vec3 dest);
+void mat3x4_mul(const mat3x4 m1, const mat3x4 m2, mat3x4 dest);
 
 void perspective_lh_zo(float fovy, float aspect, float nearZ, float farZ, mat4 dest);
+void ortho_lh_zo(float left, float right, float bottom, float top, float nearZ, float farZ, mat4 dest);
 void lookat_lh(const vec3 eye, const vec3 center, const vec3 up, mat4 dest);
 void euler_xyz(const vec3 angles, mat4 dest);
+void mat4_frustum_planes(const mat4 m, vec4 dest[6]);
@@ -0,0 +1,199 @@
+#include "lights.h"
+#include "game.h"
+#include "gpu.h"
+#include "entity.h"
+
+#define CLUSTER_GROUP_SIZE 64
+#define CLUSTER_INDEX_CAPACITY (CLUSTER_COUNT * CLUSTER_AVERAGE_LIGHTS)
+
+bool lights_init(AppState *app)
+{
+    LightSystem *lights = &app->lights;
+
+    lights->cluster_pipeline = LoadComputePipeline(app->gpu, &app->shader_pack, "light_cluster.comp");
+    if (!lights->cluster_pipeline) {
+        SDL_Log("Failed to load light cluster pipeline, lighting disabled\n%s", SDL_GetError());
+        return false;
+    }
+
+    SDL_GPUBufferCreateInfo cluster_createinfo = {
+        .usage = SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_WRITE | SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ,
+        .size  = CLUSTER_COUNT * 2 * sizeof(Uint32),
+    };
+    lights->cluster_buffer = gpumem_create_buffer(app->gpu, &cluster_createinfo, GPU_MEM_STORAGE, "light clusters");
+    SDL_GPUBufferCreateInfo index_createinfo = {
+        .usage = SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_WRITE | SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ,
+        .size  = CLUSTER_INDEX_CAPACITY * sizeof(Uint32),
+    };
+    lights->index_buffer = gpumem_create_buffer(app->gpu, &index_createinfo, GPU_MEM_STORAGE, "light indices");
+    SDL_GPUBufferCreateInfo counter_createinfo = {
+        .usage = SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_READ | SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_WRITE,
+        .size  = sizeof(Uint32),
+    };
+    lights->counter_buffer = gpumem_create_buffer(app->gpu, &counter_createinfo, GPU_MEM_STORAGE, "light counter");
+
+    if (!lights->cluster_buffer || !lights->index_buffer || !lights->counter_buffer) {
+        SDL_Log("Failed to create light cluster buffers, lighting disabled\n%s", SDL_GetError());
+        lights_release(app);
+        return false;
+    }
+    return true;
+}
+
+void lights_release(AppState *app)
+{
+    LightSystem *lights = &app->lights;
+
+    SDL_ReleaseGPUComputePipeline(app->gpu, lights->cluster_pipeline);
+    gpumem_release_buffer(app->gpu, lights->cluster_buffer);
+    gpumem_release_buffer(app->gpu, lights->index_buffer);
+    gpumem_release_buffer(app->gpu, lights->counter_buffer);
+    SDL_free(lights->lights);
+    SDL_zerop(lights);
+}
+
+int lights_add(AppState *app, const Light *light)
+{
+    LightSystem *lights = &app->lights;
+
+    if (lights->count == lights->capacity) {
+        int capacity = lights->capacity ? lights->capacity * 2 : 64;
+        Light *grown = SDL_realloc(lights->lights, capacity * sizeof *grown);
+        if (!grown) {
+            SDL_Log("Failed to grow lights to %d", capacity);
+            return -1;
+        }
+        lights->lights = grown;
+        lights->capacity = capacity;
+    }
+
+    lights->lights[lights->count] = *light;
+    return lights->count++;
+}
+
+// Writes the lights in world space and a zeroed list counter into
+// frame_data. Must be called between transient begin and upload.
+bool lights_write(AppState *app)
+{
+    LightSystem *lights = &app->lights;
+    const EntityStore *entities = &app->snapshot.entities;
+
+    Uint32 lights_offset;
+    GPULight *gpu_lights = transient_buffer_alloc(&app->frame_data, (Uint32) SDL_max(lights->count, 1) * sizeof(GPULight),
+                                                  sizeof(GPULight), &lights_offset);
+    Uint32 *counter = transient_buffer_alloc(&app->frame_data, sizeof(Uint32), sizeof(Uint32),
+                                             &lights->counter_offset);
+    if (!gpu_lights || !counter) return false;
+    *counter = 0;
+
+    Uint32 count = 0;
+    for (int i = 0; i < lights->count; i++) {
+        const Light *light = &lights->lights[i];
+        GPULight *out = &gpu_lights[count];
+
+        if (light->entity.generation != 0) {
+            // the entity is gone, so is its light
+            int e = entity_lookup(entities, light->entity);
+            if (e < 0) continue;
+            mat3x4_mulv3(entities->world[e], light->position, out->position);
+            mat3x4_mulv3_dir(entities->world[e], light->direction, out->direction);
+        } else {
+            vec3_copy(light->position, out->position);
+            vec3_copy(light->direction, out->direction);
+        }
+        vec3_copy(light->color, out->color);
+        out->range = light->range;
+
+        if (light->spot) {
+            out->spot_scale = 1.0f / SDL_max(light->cos_inner - light->cos_outer, 1e-4f);
+            out->spot_offset = -light->cos_outer * out->spot_scale;
+        } else {
+            out->spot_scale = 0;
+            out->spot_offset = 1;
+        }
+        count++;
+    }
+
+    lights->light_base = lights_offset / sizeof(GPULight);
+    lights->light_count = count;
+    return true;
+}
+
+// Resets the list counter and rebuilds every cluster's list for this view.
+void lights_cluster(AppState *app, SDL_GPUCommandBuffer *cmd_buf, const mat4 view_mat, const mat4 proj_mat,
+                    Uint32 width, Uint32 height)
+{
+    LightSystem *lights = &app->lights;
+
+    SDL_GPUCopyPass *copy_pass = SDL_BeginGPUCopyPass(cmd_buf);
+    SDL_GPUBufferLocation src = {
+        .buffer = app->frame_data.buffer,
+        .offset = lights->counter_offset,
+    };
+    SDL_GPUBufferLocation dst = {
+        .buffer = lights->counter_buffer,
+    };
+    SDL_CopyGPUBufferToBuffer(copy_pass, &src, &dst, sizeof(Uint32), true);
+    SDL_EndGPUCopyPass(copy_pass);
+
+    // rewritten as a whole, cycled so last frame's draws can still read them
+    SDL_GPUStorageBufferReadWriteBinding rw_bindings[] = {
+        { .buffer = lights->cluster_buffer, .cycle = true },
+        { .buffer = lights->index_buffer, .cycle = true },
+        { .buffer = lights->counter_buffer, .cycle = false },
+    };
+    SDL_GPUComputePass *compute_pass = SDL_BeginGPUComputePass(cmd_buf, NULL, 0, rw_bindings, SDL_arraysize(rw_bindings));
+
+    ClusterUniforms uniforms = {
+        .proj_x = proj_mat[0][0],
+        .proj_y = proj_mat[1][1],
+        .znear = CAMERA_NEAR,
+        .zfar = CAMERA_FAR,
+        .render_width = (float) width,
+        .render_height = (float) height,
+        .light_base = lights->light_base,
+        .light_count = lights->light_count,
+        .index_capacity = CLUSTER_INDEX_CAPACITY,
+    };
+    mat4_copy(view_mat, uniforms.view);
+    SDL_PushGPUComputeUniformData(cmd_buf, 0, &uniforms, sizeof(uniforms));
+
+    SDL_BindGPUComputePipeline(compute_pass, lights->cluster_pipeline);
+    SDL_BindGPUComputeStorageBuffers(compute_pass, 0, &app->frame_data.buffer, 1);
+    SDL_DispatchGPUCompute(compute_pass, (CLUSTER_COUNT + CLUSTER_GROUP_SIZE - 1) / CLUSTER_GROUP_SIZE, 1, 1);
+
+    SDL_EndGPUComputePass(compute_pass);
+}
+
+// Binds the light lists and the shadow map and pushes the fragment uniforms
+// of the LIT pipelines, once per render pass.
+void lights_bind(AppState *app, SDL_GPURenderPass *render_pass, SDL_GPUCommandBuffer *cmd_buf,
+                 Uint32 width, Uint32 height)
+{
+    LightSystem *lights = &app->lights;
+    if (!lights->cluster_pipeline) return;
+
+    float depth_range = SDL_logf(CAMERA_FAR / CAMERA_NEAR);
+    LightUniforms uniforms = {
+        .tile_width = (float) width / CLUSTER_X,
+        .tile_height = (float) height / CLUSTER_Y,
+        .slice_scale = CLUSTER_Z / depth_range,
+        .slice_bias = -CLUSTER_Z * SDL_logf(CAMERA_NEAR) / depth_range,
+        .light_base = lights->light_base,
+    };
+    vec3_copy(LIGHT_AMBIENT, uniforms.ambient);
+    vec3_normalize_to(MOON_DIRECTION, uniforms.moon_direction);
+    vec3_copy(MOON_COLOR, uniforms.moon_color);
+    mat4_copy(app->shadow.view_proj, uniforms.shadow_view_proj);
+    uniforms.shadow_normal_offset = 3 * SHADOW_EXTENT / SHADOW_MAP_SIZE;
+    SDL_PushGPUFragmentUniformData(cmd_buf, 0, &uniforms, sizeof(uniforms));
+
+    // slot 0 of both is the material table's, the LIT variants are all TEXTURED
+    SDL_GPUTextureSamplerBinding shadow_binding = {
+        .texture = app->shadow.texture,
+        .sampler = app->shadow.sampler,
+    };
+    SDL_BindGPUFragmentSamplers(render_pass, 1, &shadow_binding, 1);
+    SDL_GPUBuffer *storage_buffers[] = { app->frame_data.buffer, lights->cluster_buffer, lights->index_buffer };
+    SDL_BindGPUFragmentStorageBuffers(render_pass, 1, storage_buffers, SDL_arraysize(storage_buffers));
+}
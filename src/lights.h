@@ -0,0 +1,14 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "common.h"
+
+bool lights_init(AppState *app);
+void lights_release(AppState *app);
+int  lights_add(AppState *app, const Light *light);
+
+bool lights_write(AppState *app);
+void lights_cluster(AppState *app, SDL_GPUCommandBuffer *cmd_buf, const mat4 view_mat, const mat4 proj_mat,
+                    Uint32 width, Uint32 height);
+void lights_bind(AppState *app, SDL_GPURenderPass *render_pass, SDL_GPUCommandBuffer *cmd_buf,
+                 Uint32 width, Uint32 height);
@@ -3,6 +3,22 @@
 #include <SDL3/SDL.h>
 #include "common.h"
 #include "game.h"
+#include "gpu.h"
+#include "pipeline.h"
+#include "drawlist.h"
+#include "gpucull.h"
+#include "instances.h"
+#include "cull.h"
+#include "record.h"
+#include "sim.h"
+#include "pacing.h"
+#include "dynres.h"
+#include "rendergraph.h"
+#include "rtpool.h"
+#include "lights.h"
+#include "shadow.h"
+#include "material.h"
+#include "entity.h"
 
 bool app_create(void **appstate, AppState **app)
 {
@@ -19,7 +35,8 @@ bool app_create(void **appstate, AppState **app)
 }
 
 void try_depth_format(SDL_GPUDevice *device, SDL_GPUTextureFormat *depth_texture_format, SDL_GPUTextureFormat format) {
-    if (SDL_GPUTextureSupportsFormat(device, format, SDL_GPU_TEXTURETYPE_2D, SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET)) {
+    if (SDL_GPUTextureSupportsFormat(device, format, SDL_GPU_TEXTURETYPE_2D,
+                                     SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET | SDL_GPU_TEXTUREUSAGE_SAMPLER)) {
         *depth_texture_format = format;
     }
 }
@@ -29,12 +46,20 @@ bool app_init(AppState *app)
     app->window_width = 1280;
     app->window_height = 780;
 
-    app->window = SDL_CreateWindow("title", (int) app->window_width, (int) app->window_height, SDL_WINDOW_HIGH_PIXEL_DENSITY);
+    app->window = SDL_CreateWindow("title", (int) app->window_width, (int) app->window_height,
+                                   SDL_WINDOW_HIGH_PIXEL_DENSITY | SDL_WINDOW_RESIZABLE);
     if (!app->window) {
         SDL_Log("Failed to create window\n%s", SDL_GetError());
         return false;
     }
 
+    // render targets follow the swapchain, which is in pixels
+    int pixel_width, pixel_height;
+    if (SDL_GetWindowSizeInPixels(app->window, &pixel_width, &pixel_height)) {
+        app->window_width = (Uint32) pixel_width;
+        app->window_height = (Uint32) pixel_height;
+    }
+
     app->gpu = SDL_CreateGPUDevice(SDL_GPU_SHADERFORMAT_SPIRV | SDL_GPU_SHADERFORMAT_DXIL, true, NULL);
     if (!app->gpu) {
         SDL_Log("Failed to create gpu device\n%s", SDL_GetError());
@@ -46,7 +71,21 @@ bool app_init(AppState *app)
         return false;
     }
 
-    SDL_SetGPUSwapchainParameters(app->gpu, app->window, SDL_GPU_SWAPCHAINCOMPOSITION_SDR_LINEAR, SDL_GPU_PRESENTMODE_VSYNC);
+    // APP_PRESENT_MODE=mailbox|immediate trades tearing or wasted frames for
+    // latency, APP_FPS_LIMIT caps the frame rate when vsync doesn't
+    const char *present_mode = SDL_getenv("APP_PRESENT_MODE");
+    SDL_GPUPresentMode mode = SDL_GPU_PRESENTMODE_VSYNC;
+    if (present_mode && SDL_strcasecmp(present_mode, "mailbox") == 0) mode = SDL_GPU_PRESENTMODE_MAILBOX;
+    if (present_mode && SDL_strcasecmp(present_mode, "immediate") == 0) mode = SDL_GPU_PRESENTMODE_IMMEDIATE;
+    pacing_set_present_mode(app, mode);
+    app->pacing.fps_limit = SDL_getenv("APP_FPS_LIMIT") ? (Uint32) SDL_atoi(SDL_getenv("APP_FPS_LIMIT")) : 0;
+
+    const char *frames_in_flight = SDL_getenv("APP_FRAMES_IN_FLIGHT");
+    app->frames_in_flight = frames_in_flight ? (Uint32) SDL_atoi(frames_in_flight) : FRAMES_IN_FLIGHT_DEFAULT;
+    app->frames_in_flight = SDL_clamp(app->frames_in_flight, 1, FRAMES_IN_FLIGHT_MAX);
+    if (!SDL_SetGPUAllowedFramesInFlight(app->gpu, app->frames_in_flight)) {
+        SDL_Log("Failed to set %u frames in flight\n%s", app->frames_in_flight, SDL_GetError());
+    }
     app->swapchain_texture_format = SDL_GetGPUSwapchainTextureFormat(app->gpu, app->window);
 
     app->depth_texture_format = SDL_GPU_TEXTUREFORMAT_D16_UNORM;
@@ -54,15 +93,33 @@ bool app_init(AppState *app)
     try_depth_format(app->gpu, &app->depth_texture_format, SDL_GPU_TEXTUREFORMAT_D24_UNORM);
     // SDL_Log("Using texture format: %d", depth_texture_format);
 
-    SDL_GPUTextureCreateInfo depth_tex_createinfo = {
-        .format = app->depth_texture_format,
-        .usage = SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET,
-        .width = app->window_width,
-        .height = app->window_height,
-        .layer_count_or_depth = 1,
-        .num_levels = 1,
-    };
-    app->depth_texture = SDL_CreateGPUTexture(app->gpu, &depth_tex_createinfo);
+    // the scene renders into the top-left corner of the render graph's
+    // window sized targets, its size picked every frame to fit the budget
+    dynres_init(app);
+    rt_pool_init(&app->targets);
+
+    if (!jobs_init(&app->jobs, SDL_GetNumLogicalCPUCores() - 1)) {
+        return false;
+    }
+
+    if (!pipeline_cache_init(&app->pipelines)) {
+        return false;
+    }
+
+    if (!record_queue_init(&app->record)) {
+        return false;
+    }
+
+    if (!shader_pack_open(&app->shader_pack, SHADER_PACK_PATH)) {
+        SDL_Log("No shader pack at %s, loading loose shader files", SHADER_PACK_PATH);
+    }
+
+    gpumem_set_budget(GPU_MEM_BUDGET);
+
+    if (!transient_buffer_create(app->gpu, &app->frame_data, TRANSIENT_BUFFER_SIZE,
+                                 SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ | SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_READ)) {
+        return false;
+    }
 
     return true;
 }
@@ -90,7 +147,15 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char **argv)
         return SDL_APP_FAILURE;
     }
 
-    game_init(app);
+    if (!game_init(app)) {
+        SDL_Log("Failed to initialize game");
+        return SDL_APP_FAILURE;
+    }
+    if (!game_snapshot(app)) {
+        SDL_Log("Failed to snapshot the game");
+        return SDL_APP_FAILURE;
+    }
+    sim_start(app);
 
     SDL_SetWindowRelativeMouseMode(app->window, true);
     app->time.last_ticks = SDL_GetTicks();
@@ -105,17 +170,83 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event)
     switch (event->type)
     {
         case SDL_EVENT_KEY_DOWN:
-            app->key_down[event->key.scancode] = true;
+            app->input.key_down[event->key.scancode] = true;
+            app->input.event_ns = event->common.timestamp;
             break;
         case SDL_EVENT_KEY_UP:
             if (event->key.key == SDLK_ESCAPE) {
                 return SDL_APP_SUCCESS;
             }
-            app->key_down[event->key.scancode] = false;
+            if (event->key.key == SDLK_F1) {
+                gpumem_report(GPU_MEM_REPORT_TOP);
+            }
+            if (event->key.key == SDLK_F2) {
+                DrawStats stats = app->draw_list.stats;
+                CullStats cull = app->cull_stats;
+                SDL_Log("draw list: %u items, %u draws, %u binds, %u binds skipped",
+                        stats.items, stats.draws, stats.binds, stats.binds_skipped);
+                SDL_Log("frustum culling: %u tested, %u drawn, %u culled", cull.tested, cull.visible, cull.culled);
+                SDL_Log("input to submit: %.2f ms, %s, %u frame(s) in flight",
+                        (double) app->pacing.input_latency_ms, pacing_present_mode_name(app->pacing.present_mode),
+                        app->frames_in_flight);
+                SDL_Log("render scale %.2f (%ux%u), cpu %.2f ms, gpu %.2f ms, budget %.2f ms",
+                        (double) app->dynres.scale, app->dynres.width, app->dynres.height,
+                        (double) app->dynres.cpu_ms, (double) app->dynres.gpu_ms, (double) app->dynres.budget_ms);
+                GraphStats graph = app->graph.stats;
+                SDL_Log("render graph: %u passes, %u culled, %u transient on %u textures, %u aliased",
+                        graph.passes, graph.culled, graph.transient, graph.textures, graph.aliased);
+                RenderTargetPoolStats pool = app->targets.stats;
+                SDL_Log("render targets: %u pooled, %u created, %u released",
+                        pool.targets, pool.created, pool.released);
+                SDL_Log("lights: %u in %d clusters", app->lights.light_count, CLUSTER_COUNT);
+                ShadowStats shadow = app->shadow.stats;
+                SDL_Log("shadow: %u static casters cached, %u dynamic, %u rebuilds",
+                        shadow.static_casters, shadow.dynamic_casters, shadow.rebuilds);
+                InstanceStats instances = app->instances.stats;
+                SDL_Log("instances: %u records, %u uploaded last frame, %u full uploads",
+                        app->instances.count, instances.uploaded, instances.full_uploads);
+            }
+            if (event->key.key == SDLK_F3 && app->gpu_cull.cull_pipeline) {
+                app->gpu_culling = !app->gpu_culling;
+                app->gpu_cull.history = false;
+                SDL_Log("gpu culling %s", app->gpu_culling ? "on" : "off");
+            }
+            if (event->key.key == SDLK_F4) {
+                app->depth_prepass = !app->depth_prepass;
+                SDL_Log("depth prepass %s", app->depth_prepass ? "on" : "off");
+            }
+            if (event->key.key == SDLK_F5) {
+                app->draw_order = (app->draw_order + 1) % DRAW_ORDER_COUNT;
+                SDL_Log("draw order %s", app->draw_order == DRAW_ORDER_FRONT_TO_BACK ? "front to back" : "state");
+            }
+            if (event->key.key == SDLK_F6) {
+                app->parallel_recording = !app->parallel_recording;
+                SDL_Log("parallel recording %s", app->parallel_recording ? "on" : "off");
+            }
+            if (event->key.key == SDLK_F7) {
+                pacing_next_present_mode(app);
+            }
+            if (event->key.key == SDLK_F8) {
+                app->dynres.enabled = !app->dynres.enabled;
+                SDL_Log("dynamic resolution %s", app->dynres.enabled ? "on" : "off");
+            }
+            if (event->key.key == SDLK_F9) {
+                app->input.traffic = !app->input.traffic;
+                SDL_Log("traffic %s", app->input.traffic ? "on" : "off");
+            }
+            app->input.key_down[event->key.scancode] = false;
+            app->input.event_ns = event->common.timestamp;
             break;
         case SDL_EVENT_MOUSE_MOTION:
-            app->mouse_move[0] = event->motion.xrel;
-            app->mouse_move[1] = event->motion.yrel;
+            app->input.mouse_move[0] += event->motion.xrel;
+            app->input.mouse_move[1] += event->motion.yrel;
+            app->input.event_ns = event->common.timestamp;
+            break;
+        case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
+            // targets of the new size come from the pool, the old ones
+            // retire once they have gone unused for a while
+            app->window_width = (Uint32) SDL_max(event->window.data1, 1);
+            app->window_height = (Uint32) SDL_max(event->window.data2, 1);
             break;
         case SDL_EVENT_QUIT:
             return SDL_APP_SUCCESS;
@@ -126,29 +257,55 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event)
 SDL_AppResult SDL_AppIterate(void *appstate)
 {
     AppState *app = (AppState *) appstate;
-    
-    TimeState *time = &app->time;
-    time->new_ticks = SDL_GetTicks();
-    time->delta_time = (float) (time->new_ticks - time->last_ticks) / 1000.0f;
-    time->last_ticks = time->new_ticks;
 
-    game_update(app);
-
-    // render
     SDL_GPUCommandBuffer *cmd_buf = SDL_AcquireGPUCommandBuffer(app->gpu);
     if (!cmd_buf) {
         SDL_Log("SDL_AcquireGPUCommandBuffer failed\n%s", SDL_GetError());
         return SDL_APP_FAILURE;
     }
 
+    // does not block, no texture means all frames in flight are still busy.
+    // Decided before the simulation is touched: a skipped frame leaves the
+    // update in flight running and the input unlatched for the next one.
     SDL_GPUTexture *swapchain_tex = NULL;
-    SDL_WaitAndAcquireGPUSwapchainTexture(cmd_buf, app->window, &swapchain_tex, NULL, NULL);
+    if (!SDL_AcquireGPUSwapchainTexture(cmd_buf, app->window, &swapchain_tex,
+                                        &app->swapchain_width, &app->swapchain_height)) {
+        SDL_Log("SDL_AcquireGPUSwapchainTexture failed\n%s", SDL_GetError());
+    }
+
+    if (!swapchain_tex) {
+        SDL_CancelGPUCommandBuffer(cmd_buf);
+        // don't spin while the gpu catches up
+        SDL_Delay(1);
+        return SDL_APP_CONTINUE;
+    }
+
+    // the update started last iteration becomes this frame's snapshot
+    sim_wait(app);
+    bool snapshot = game_snapshot(app);
+    dynres_begin_frame(app);
+    rt_pool_begin_frame(app->gpu, &app->targets);
+
+    TimeState *time = &app->time;
+    time->new_ticks = SDL_GetTicks();
+    time->delta_time = (float) (time->new_ticks - time->last_ticks) / 1000.0f;
+    time->last_ticks = time->new_ticks;
+
+    // the next update runs on the simulation thread while this one renders
+    pacing_latch_input(app);
+    sim_kick(app);
 
-    if (swapchain_tex) {
+    // render, or just clear when the snapshot is stale
+    if (snapshot) {
         game_render(app, cmd_buf, swapchain_tex);
+    } else {
+        game_clear_swapchain(app, cmd_buf, swapchain_tex);
     }
 
-    SDL_SubmitGPUCommandBuffer(cmd_buf); 
+    // submitted last, so its fence covers everything the frame used
+    rt_pool_end_frame(app->gpu, &app->targets, SDL_SubmitGPUCommandBufferAndAcquireFence(cmd_buf));
+    pacing_frame_submitted(app);
+    pacing_wait(app);
     return SDL_APP_CONTINUE;
 }
 
@@ -158,24 +315,38 @@ void SDL_AppQuit(void *appstate, SDL_AppResult result)
 
     if (appstate) {
         AppState *app = (AppState *) appstate;
+        sim_stop(app);
+        SDL_WaitForGPUIdle(app->gpu);
+        dynres_release(app);
 
         Model model;
         for (int i = 0; i < app->model_count; i++) {
             model = app->models[i];
-            SDL_ReleaseGPUBuffer(app->gpu, model.mesh.vertex_buffer);
-            SDL_ReleaseGPUBuffer(app->gpu, model.mesh.index_buffer);
-            if (i == 0 || i == 2) {
-                SDL_ReleaseGPUTexture(app->gpu, model.texture);
-            }
+            gpumem_release_buffer(app->gpu, model.mesh.vertex_buffer);
+            gpumem_release_buffer(app->gpu, model.mesh.index_buffer);
         }
+        materials_release(app);
 
-        SDL_ReleaseGPUGraphicsPipeline(app->gpu, app->pipeline);
+        pipeline_cache_release(app->gpu, &app->pipelines);
+        shader_pack_close(&app->shader_pack);
         SDL_ReleaseGPUSampler(app->gpu, app->sampler);
-        SDL_ReleaseGPUTexture(app->gpu, app->depth_texture);
+        rt_pool_release(app->gpu, &app->targets);
+        transient_buffer_release(app->gpu, &app->frame_data);
+        draw_list_release(&app->draw_list);
+        cull_buffers_release(&app->cull);
+        gpu_cull_release(app);
+        instances_release(app);
+        lights_release(app);
+        shadow_release(app);
+        entity_store_release(&app->entities);
+        entity_store_release(&app->snapshot.entities);
+        gpumem_report_leaks();
 
         SDL_ReleaseWindowFromGPUDevice(app->gpu, app->window);
         SDL_DestroyGPUDevice(app->gpu);
         SDL_DestroyWindow(app->window);
+        jobs_shutdown(&app->jobs);
+        record_queue_release(&app->record);
 
         SDL_free(app);
     }
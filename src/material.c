@@ -0,0 +1,156 @@
+#include "material.h"
+#include "game.h"
+#include "gpu.h"
+#include "asset.h"
+
+bool materials_init(AppState *app)
+{
+    MaterialTable *table = &app->materials;
+
+    SDL_GPUTextureCreateInfo texture_createinfo = {
+        .type = SDL_GPU_TEXTURETYPE_2D_ARRAY,
+        .format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM_SRGB,
+        .usage = SDL_GPU_TEXTUREUSAGE_SAMPLER,
+        .width = MATERIAL_TEXTURE_SIZE,
+        .height = MATERIAL_TEXTURE_SIZE,
+        .layer_count_or_depth = MATERIAL_MAX_LAYERS,
+        .num_levels = 1,
+    };
+    table->textures = gpumem_create_texture(app->gpu, &texture_createinfo, GPU_MEM_TEXTURE, "material textures");
+    if (!table->textures) {
+        SDL_Log("Failed to create material texture array\n%s", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+void materials_release(AppState *app)
+{
+    MaterialTable *table = &app->materials;
+
+    gpumem_release_texture(app->gpu, table->textures);
+    gpumem_release_buffer(app->gpu, table->buffer);
+    SDL_free(table->materials);
+    SDL_zerop(table);
+}
+
+// Returns the layer holding the texture, loading it into the next free one
+// on first use, or -1.
+int material_layer(AppState *app, SDL_GPUCopyPass *copy_pass, const char *texturefile)
+{
+    MaterialTable *table = &app->materials;
+
+    for (Uint32 i = 0; i < table->layer_count; i++) {
+        if (SDL_strcmp(table->layer_files[i], texturefile) == 0) return (int) i;
+    }
+    if (table->layer_count == MATERIAL_MAX_LAYERS) {
+        SDL_Log("Material texture array full (%d layers), can't load %s", MATERIAL_MAX_LAYERS, texturefile);
+        return -1;
+    }
+    if (!load_texture_layer(app->gpu, copy_pass, table->textures, table->layer_count,
+                            MATERIAL_TEXTURE_SIZE, texturefile)) {
+        return -1;
+    }
+
+    SDL_strlcpy(table->layer_files[table->layer_count], texturefile, MATERIAL_FILE_LEN);
+    return (int) table->layer_count++;
+}
+
+int material_add(AppState *app, const Material *material)
+{
+    MaterialTable *table = &app->materials;
+
+    if (table->count == table->capacity) {
+        int capacity = table->capacity ? table->capacity * 2 : 16;
+        Material *grown = SDL_realloc(table->materials, capacity * sizeof *grown);
+        if (!grown) {
+            SDL_Log("Failed to grow material table to %d", capacity);
+            return -1;
+        }
+        table->materials = grown;
+        table->capacity = capacity;
+    }
+
+    table->materials[table->count] = *material;
+    table->dirty = true;
+    return table->count++;
+}
+
+// Uploads the table if it changed since the last upload, growing the
+// buffer as needed. Materials are few and change rarely, so the whole
+// table goes up at once.
+bool materials_upload(AppState *app, SDL_GPUCommandBuffer *cmd_buf)
+{
+    MaterialTable *table = &app->materials;
+    if (!table->dirty) return true;
+
+    if (!table->buffer || table->buffer_capacity < table->count) {
+        int capacity = SDL_max(table->buffer_capacity, 16);
+        while (capacity < table->count) capacity *= 2;
+
+        SDL_GPUBufferCreateInfo buffer_createinfo = {
+            .usage = SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ,
+            .size  = (Uint32) capacity * sizeof(GPUMaterial),
+        };
+        SDL_GPUBuffer *buffer = gpumem_create_buffer(app->gpu, &buffer_createinfo, GPU_MEM_STORAGE, "materials");
+        if (!buffer) {
+            SDL_Log("Failed to grow material buffer to %d\n%s", capacity, SDL_GetError());
+            return false;
+        }
+        gpumem_release_buffer(app->gpu, table->buffer);
+        table->buffer = buffer;
+        table->buffer_capacity = capacity;
+    }
+
+    Uint32 size = (Uint32) table->count * sizeof(GPUMaterial);
+    SDL_GPUTransferBufferCreateInfo transfer_createinfo = {
+        .usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD,
+        .size = size,
+    };
+    SDL_GPUTransferBuffer *transfer = gpumem_create_transfer_buffer(app->gpu, &transfer_createinfo, "materials");
+    GPUMaterial *mapped = transfer ? SDL_MapGPUTransferBuffer(app->gpu, transfer, false) : NULL;
+    if (!mapped) {
+        SDL_Log("Failed to map material upload\n%s", SDL_GetError());
+        gpumem_release_transfer_buffer(app->gpu, transfer);
+        return false;
+    }
+    for (int i = 0; i < table->count; i++) {
+        mapped[i] = (GPUMaterial) {
+            .base_color = {
+                table->materials[i].base_color[0], table->materials[i].base_color[1],
+                table->materials[i].base_color[2], table->materials[i].base_color[3],
+            },
+            .layer = table->materials[i].layer,
+        };
+    }
+    SDL_UnmapGPUTransferBuffer(app->gpu, transfer);
+
+    SDL_GPUCopyPass *copy_pass = SDL_BeginGPUCopyPass(cmd_buf);
+    SDL_GPUTransferBufferLocation src = {
+        .transfer_buffer = transfer,
+    };
+    SDL_GPUBufferRegion dst = {
+        .buffer = table->buffer,
+        .size = size,
+    };
+    SDL_UploadToGPUBuffer(copy_pass, &src, &dst, true);
+    SDL_EndGPUCopyPass(copy_pass);
+    gpumem_release_transfer_buffer(app->gpu, transfer);
+
+    table->dirty = false;
+    return true;
+}
+
+// The texture array and the table for every non-depth pipeline, once per
+// render pass. Fragment sampler and storage slot 0.
+void materials_bind(AppState *app, SDL_GPURenderPass *render_pass)
+{
+    MaterialTable *table = &app->materials;
+
+    SDL_GPUTextureSamplerBinding tex_binding = {
+        .texture = table->textures,
+        .sampler = app->sampler,
+    };
+    SDL_BindGPUFragmentSamplers(render_pass, 0, &tex_binding, 1);
+    SDL_BindGPUFragmentStorageBuffers(render_pass, 0, &table->buffer, 1);
+}
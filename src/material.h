@@ -0,0 +1,12 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "common.h"
+
+bool materials_init(AppState *app);
+void materials_release(AppState *app);
+int  material_layer(AppState *app, SDL_GPUCopyPass *copy_pass, const char *texturefile);
+int  material_add(AppState *app, const Material *material);
+
+bool materials_upload(AppState *app, SDL_GPUCommandBuffer *cmd_buf);
+void materials_bind(AppState *app, SDL_GPURenderPass *render_pass);
@@ -0,0 +1,103 @@
+#include "pacing.h"
+
+const char *pacing_present_mode_name(SDL_GPUPresentMode mode)
+{
+    switch (mode) {
+        case SDL_GPU_PRESENTMODE_IMMEDIATE: return "immediate";
+        case SDL_GPU_PRESENTMODE_MAILBOX:   return "mailbox";
+        case SDL_GPU_PRESENTMODE_VSYNC:
+        default:                            return "vsync";
+    }
+}
+
+// Falls back to VSYNC, the only mode every backend has to support.
+bool pacing_set_present_mode(AppState *app, SDL_GPUPresentMode mode)
+{
+    if (!SDL_WindowSupportsGPUPresentMode(app->gpu, app->window, mode)) {
+        SDL_Log("Present mode %s not supported, using vsync", pacing_present_mode_name(mode));
+        mode = SDL_GPU_PRESENTMODE_VSYNC;
+    }
+
+    if (!SDL_SetGPUSwapchainParameters(app->gpu, app->window, SDL_GPU_SWAPCHAINCOMPOSITION_SDR_LINEAR, mode)) {
+        SDL_Log("Failed to set present mode %s\n%s", pacing_present_mode_name(mode), SDL_GetError());
+        return false;
+    }
+    app->pacing.present_mode = mode;
+    return true;
+}
+
+void pacing_next_present_mode(AppState *app)
+{
+    static const SDL_GPUPresentMode modes[] = {
+        SDL_GPU_PRESENTMODE_VSYNC,
+        SDL_GPU_PRESENTMODE_MAILBOX,
+        SDL_GPU_PRESENTMODE_IMMEDIATE,
+    };
+
+    int current = 0;
+    for (int i = 0; i < (int) SDL_arraysize(modes); i++) {
+        if (modes[i] == app->pacing.present_mode) current = i;
+    }
+    // skip the modes this window can't do
+    for (int step = 1; step < (int) SDL_arraysize(modes); step++) {
+        SDL_GPUPresentMode mode = modes[(current + step) % SDL_arraysize(modes)];
+        if (SDL_WindowSupportsGPUPresentMode(app->gpu, app->window, mode)) {
+            pacing_set_present_mode(app, mode);
+            break;
+        }
+    }
+    SDL_Log("present mode %s, fps limit %u", pacing_present_mode_name(app->pacing.present_mode), app->pacing.fps_limit);
+}
+
+// Hands the input gathered since the last latch to the update about to
+// start and remembers when its newest event happened.
+void pacing_latch_input(AppState *app)
+{
+    app->sim_input = app->input;
+    app->pacing.latched_event_ns = app->input.event_ns;
+    vec2_zero(app->input.mouse_move);
+    app->input.event_ns = 0;
+}
+
+// Input to submit latency of frames that had input. The time from submit
+// to photons adds roughly one refresh per frame queued ahead of it.
+void pacing_frame_submitted(AppState *app)
+{
+    FramePacing *pacing = &app->pacing;
+    if (!pacing->latched_event_ns) return;
+
+    float sample = (float) (SDL_GetTicksNS() - pacing->latched_event_ns) / (float) SDL_NS_PER_MS;
+    pacing->input_latency_ms = pacing->input_latency_ms > 0
+                             ? pacing->input_latency_ms * 0.9f + sample * 0.1f
+                             : sample;
+}
+
+// Sleep-then-spin limiter: SDL_DelayNS wakes up late by up to a scheduler
+// tick, so it only sleeps until FRAME_LIMITER_SPIN_NS before the deadline
+// and the rest is spent polling the clock. Called at the end of a frame so
+// the events delivered right after it are the ones the next frame latches.
+void pacing_wait(AppState *app)
+{
+    FramePacing *pacing = &app->pacing;
+    if (pacing->fps_limit == 0) {
+        pacing->frame_deadline_ns = 0;
+        return;
+    }
+
+    Uint64 frame_ns = SDL_NS_PER_SECOND / pacing->fps_limit;
+    Uint64 now = SDL_GetTicksNS();
+
+    // start over after a hitch instead of rushing to catch up
+    if (pacing->frame_deadline_ns == 0 || now > pacing->frame_deadline_ns + frame_ns) {
+        pacing->frame_deadline_ns = now + frame_ns;
+        return;
+    }
+
+    if (pacing->frame_deadline_ns > now + FRAME_LIMITER_SPIN_NS) {
+        SDL_DelayNS(pacing->frame_deadline_ns - now - FRAME_LIMITER_SPIN_NS);
+    }
+    while (SDL_GetTicksNS() < pacing->frame_deadline_ns) {
+        SDL_CPUPauseInstruction();
+    }
+    pacing->frame_deadline_ns += frame_ns;
+}
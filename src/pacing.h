@@ -0,0 +1,12 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "common.h"
+
+bool pacing_set_present_mode(AppState *app, SDL_GPUPresentMode mode);
+void pacing_next_present_mode(AppState *app);
+const char *pacing_present_mode_name(SDL_GPUPresentMode mode);
+
+void pacing_latch_input(AppState *app);
+void pacing_frame_submitted(AppState *app);
+void pacing_wait(AppState *app);
@@ -0,0 +1,247 @@
+#include "pipeline.h"
+#include "game.h"
+
+static const SDL_GPUVertexAttribute mesh_attrs[] = {
+    {
+        .location = 0,
+        .format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3,
+        .offset = offsetof(Vertex, pos),
+    },
+    {
+        .location = 1,
+        .format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT4,
+        .offset = offsetof(Vertex, color),
+    },
+    {
+        .location = 2,
+        .format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT2,
+        .offset = offsetof(Vertex, uv),
+    },
+    {
+        .location = 3,
+        .format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3,
+        .offset = offsetof(Vertex, normal),
+    },
+};
+
+// depth prepass, same vertex buffers as the mesh layout
+static const SDL_GPUVertexAttribute position_attrs[] = {
+    {
+        .location = 0,
+        .format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT3,
+        .offset = offsetof(Vertex, pos),
+    },
+};
+
+static const SDL_GPUVertexBufferDescription mesh_buffer = {
+    .slot = 0,
+    .pitch = sizeof(Vertex),
+};
+
+static SDL_GPUVertexInputState vertex_input_state(VertexLayout layout)
+{
+    switch (layout) {
+        case VERTEX_LAYOUT_POSITION:
+            return (SDL_GPUVertexInputState) {
+                .num_vertex_buffers = 1,
+                .vertex_buffer_descriptions = &mesh_buffer,
+                .num_vertex_attributes = SDL_arraysize(position_attrs),
+                .vertex_attributes = position_attrs,
+            };
+        case VERTEX_LAYOUT_MESH:
+        default:
+            return (SDL_GPUVertexInputState) {
+                .num_vertex_buffers = 1,
+                .vertex_buffer_descriptions = &mesh_buffer,
+                .num_vertex_attributes = SDL_arraysize(mesh_attrs),
+                .vertex_attributes = mesh_attrs,
+            };
+    }
+}
+
+bool pipeline_cache_init(PipelineCache *cache)
+{
+    SDL_zerop(cache);
+    cache->lock = SDL_CreateMutex();
+    if (!cache->lock) {
+        SDL_Log("Failed to create pipeline cache lock\n%s", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+void pipeline_cache_release(SDL_GPUDevice *gpu, PipelineCache *cache)
+{
+    for (int i = 0; i < PIPELINE_CACHE_SIZE; i++) {
+        SDL_ReleaseGPUGraphicsPipeline(gpu, cache->entries[i].pipeline);
+    }
+    SDL_DestroyMutex(cache->lock);
+    SDL_zerop(cache);
+}
+
+PipelineDesc pipeline_desc_default(const AppState *app)
+{
+    return (PipelineDesc) {
+        .vertex_layout = VERTEX_LAYOUT_MESH,
+        .primitive_type = SDL_GPU_PRIMITIVETYPE_TRIANGLELIST,
+        .fill_mode = SDL_GPU_FILLMODE_FILL,
+        .cull_mode = SDL_GPU_CULLMODE_FRONT,
+        .depth_compare = SDL_GPU_COMPAREOP_LESS,
+        .depth_test = true,
+        .depth_write = true,
+        .num_color_targets = 1,
+        .color_format = app->swapchain_texture_format,
+        .depth_format = app->depth_texture_format,
+    };
+}
+
+// FNV-1a over the whole desc, so descs must be zero-initialized
+Uint64 pipeline_desc_hash(const PipelineDesc *desc)
+{
+    const Uint8 *bytes = (const Uint8 *) desc;
+    Uint64 hash = 14695981039346656037ull;
+    for (size_t i = 0; i < sizeof(*desc); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static PipelineCacheEntry *cache_slot(PipelineCache *cache, Uint64 hash, const PipelineDesc *desc)
+{
+    Uint32 mask = PIPELINE_CACHE_SIZE - 1;
+    for (Uint32 i = 0; i < PIPELINE_CACHE_SIZE; i++) {
+        PipelineCacheEntry *entry = &cache->entries[(hash + i) & mask];
+        if (!entry->pipeline) return entry;
+        if (entry->hash == hash && SDL_memcmp(&entry->desc, desc, sizeof(*desc)) == 0) return entry;
+    }
+    return NULL;
+}
+
+static SDL_GPUGraphicsPipeline *create_pipeline(AppState *app, const PipelineDesc *desc)
+{
+    SDL_GPUShader *vertex_shader = LoadShader(app->gpu, &app->shader_pack, desc->vertex_shader);
+    SDL_GPUShader *fragment_shader = LoadShader(app->gpu, &app->shader_pack, desc->fragment_shader);
+    if (!vertex_shader || !fragment_shader) {
+        SDL_ReleaseGPUShader(app->gpu, vertex_shader);
+        SDL_ReleaseGPUShader(app->gpu, fragment_shader);
+
+        SDL_Log("Failed to load shader(s) %s / %s\n%s", desc->vertex_shader, desc->fragment_shader, SDL_GetError());
+        return NULL;
+    }
+
+    SDL_GPUGraphicsPipelineCreateInfo pipeline_createinfo = {
+        .vertex_shader = vertex_shader,
+        .fragment_shader = fragment_shader,
+        .vertex_input_state = vertex_input_state((VertexLayout) desc->vertex_layout),
+        .primitive_type = (SDL_GPUPrimitiveType) desc->primitive_type,
+        .rasterizer_state = (SDL_GPURasterizerState) {
+            .cull_mode = (SDL_GPUCullMode) desc->cull_mode,
+            .fill_mode = (SDL_GPUFillMode) desc->fill_mode,
+            .depth_bias_constant_factor = desc->depth_bias_constant,
+            .depth_bias_slope_factor = desc->depth_bias_slope,
+            .enable_depth_bias = desc->depth_bias_constant != 0 || desc->depth_bias_slope != 0,
+        },
+        .depth_stencil_state = (SDL_GPUDepthStencilState) {
+            .enable_depth_test = desc->depth_test,
+            .enable_depth_write = desc->depth_write,
+            .compare_op = (SDL_GPUCompareOp) desc->depth_compare,
+        },
+        .target_info = (SDL_GPUGraphicsPipelineTargetInfo) {
+            .num_color_targets = desc->num_color_targets,
+            .color_target_descriptions = &(SDL_GPUColorTargetDescription) {
+                .format = (SDL_GPUTextureFormat) desc->color_format,
+            },
+            .has_depth_stencil_target = desc->depth_format != SDL_GPU_TEXTUREFORMAT_INVALID,
+            .depth_stencil_format = (SDL_GPUTextureFormat) desc->depth_format,
+        }
+    };
+    SDL_GPUGraphicsPipeline *pipeline = SDL_CreateGPUGraphicsPipeline(app->gpu, &pipeline_createinfo);
+
+    SDL_ReleaseGPUShader(app->gpu, vertex_shader);
+    SDL_ReleaseGPUShader(app->gpu, fragment_shader);
+
+    return pipeline;
+}
+
+SDL_GPUGraphicsPipeline *pipeline_get(AppState *app, const PipelineDesc *desc)
+{
+    PipelineCache *cache = &app->pipelines;
+    Uint64 hash = pipeline_desc_hash(desc);
+
+    SDL_LockMutex(cache->lock);
+    PipelineCacheEntry *entry = cache_slot(cache, hash, desc);
+    SDL_GPUGraphicsPipeline *pipeline = entry ? entry->pipeline : NULL;
+    SDL_UnlockMutex(cache->lock);
+
+    if (pipeline) return pipeline;
+
+    // compile outside the lock so warm-up workers don't serialize
+    pipeline = create_pipeline(app, desc);
+    if (!pipeline) return NULL;
+
+    SDL_LockMutex(cache->lock);
+    entry = cache_slot(cache, hash, desc);
+    if (!entry) {
+        // the cache owns every pipeline it hands out, nothing would free this one
+        SDL_UnlockMutex(cache->lock);
+        SDL_Log("Pipeline cache full (%d entries)", PIPELINE_CACHE_SIZE);
+        SDL_ReleaseGPUGraphicsPipeline(app->gpu, pipeline);
+        return NULL;
+    }
+    if (entry->pipeline) {
+        // another thread compiled the same state first
+        SDL_ReleaseGPUGraphicsPipeline(app->gpu, pipeline);
+        pipeline = entry->pipeline;
+    } else {
+        entry->hash = hash;
+        entry->desc = *desc;
+        entry->pipeline = pipeline;
+        cache->count++;
+    }
+    SDL_UnlockMutex(cache->lock);
+
+    return pipeline;
+}
+
+// small stable id for draw sort keys: the pipeline's slot in the cache
+Uint32 pipeline_id(AppState *app, SDL_GPUGraphicsPipeline *pipeline)
+{
+    PipelineCache *cache = &app->pipelines;
+    Uint32 id = 0;
+
+    SDL_LockMutex(cache->lock);
+    for (Uint32 i = 0; i < PIPELINE_CACHE_SIZE; i++) {
+        if (cache->entries[i].pipeline == pipeline) {
+            id = i;
+            break;
+        }
+    }
+    SDL_UnlockMutex(cache->lock);
+
+    return id;
+}
+
+typedef struct {
+    AppState *app;
+    const PipelineDesc *descs;
+} WarmupJob;
+
+static void warmup_one(void *userdata, int index)
+{
+    WarmupJob *job = userdata;
+    pipeline_get(job->app, &job->descs[index]);
+}
+
+// SDL_gpu resource creation is safe from any thread, so the known
+// pipelines are compiled on the job pool before the first frame
+void pipeline_warmup(AppState *app, const PipelineDesc *descs, int count)
+{
+    Uint64 start = SDL_GetTicksNS();
+
+    WarmupJob job = { .app = app, .descs = descs };
+    jobs_parallel_for(&app->jobs, warmup_one, &job, count);
+
+    SDL_Log("Compiled %d pipeline(s) in %.2f ms on %d worker(s)",
+            count, (double) (SDL_GetTicksNS() - start) / 1e6, app->jobs.worker_count);
+}
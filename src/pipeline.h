@@ -0,0 +1,14 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "common.h"
+
+bool pipeline_cache_init(PipelineCache *cache);
+void pipeline_cache_release(SDL_GPUDevice *gpu, PipelineCache *cache);
+
+PipelineDesc pipeline_desc_default(const AppState *app);
+Uint64 pipeline_desc_hash(const PipelineDesc *desc);
+
+SDL_GPUGraphicsPipeline *pipeline_get(AppState *app, const PipelineDesc *desc);
+Uint32 pipeline_id(AppState *app, SDL_GPUGraphicsPipeline *pipeline);
+void pipeline_warmup(AppState *app, const PipelineDesc *descs, int count);
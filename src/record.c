@@ -0,0 +1,121 @@
+#include "record.h"
+#include "drawlist.h"
+#include "gpu.h"
+#include "lights.h"
+#include "material.h"
+
+typedef struct {
+    AppState *app;
+    const RecordTarget *target;
+    int slices;
+} RecordJob;
+
+bool record_queue_init(RecordQueue *queue)
+{
+    SDL_zerop(queue);
+    queue->lock = SDL_CreateMutex();
+    queue->submitted = SDL_CreateCondition();
+    if (!queue->lock || !queue->submitted) {
+        SDL_Log("Failed to create record queue\n%s", SDL_GetError());
+        record_queue_release(queue);
+        return false;
+    }
+    return true;
+}
+
+void record_queue_release(RecordQueue *queue)
+{
+    SDL_DestroyCondition(queue->submitted);
+    SDL_DestroyMutex(queue->lock);
+    SDL_zerop(queue);
+}
+
+int record_slice_count(const AppState *app, int item_count)
+{
+    if (!app->parallel_recording || !app->record.lock) return 1;
+
+    int slices = SDL_min(app->jobs.worker_count + 1, RECORD_MAX_SLICES);
+    return SDL_clamp(item_count / RECORD_SLICE_MIN_ITEMS, 1, slices);
+}
+
+static void record_slice(void *userdata, int index)
+{
+    RecordJob *job = userdata;
+    AppState *app = job->app;
+    const RecordTarget *target = job->target;
+    RecordQueue *queue = &app->record;
+    const DrawList *list = &app->draw_list;
+
+    int first = list->count * index / job->slices;
+    int end = list->count * (index + 1) / job->slices;
+    bool first_slice = index == 0;
+    bool last_slice = index == job->slices - 1;
+
+    DrawStats *stats = &queue->stats[index];
+    SDL_zerop(stats);
+
+    // acquired, recorded and submitted on this thread as SDL requires
+    SDL_GPUCommandBuffer *cmd_buf = SDL_AcquireGPUCommandBuffer(app->gpu);
+    if (!cmd_buf) {
+        SDL_Log("SDL_AcquireGPUCommandBuffer failed for slice %d\n%s", index, SDL_GetError());
+    } else {
+        SDL_GPUColorTargetInfo color_target = {
+            .texture = target->color_texture,
+            .clear_color = target->clear_color,
+            .load_op = first_slice ? target->color_load_op : SDL_GPU_LOADOP_LOAD,
+            .store_op = last_slice ? target->color_store_op : SDL_GPU_STOREOP_STORE,
+        };
+        SDL_GPUDepthStencilTargetInfo depth_target_info = {
+            .texture = target->depth_texture,
+            .load_op = first_slice ? target->depth_load_op : SDL_GPU_LOADOP_LOAD,
+            .clear_depth = 1,
+            .store_op = last_slice ? target->depth_store_op : SDL_GPU_STOREOP_STORE,
+        };
+        SDL_GPURenderPass *render_pass = SDL_BeginGPURenderPass(cmd_buf, &color_target, 1, &depth_target_info);
+        set_render_area(render_pass, target->width, target->height);
+        SDL_PushGPUVertexUniformData(cmd_buf, 0, target->uniforms, target->uniforms_size);
+        materials_bind(app, render_pass);
+        lights_bind(app, render_pass, cmd_buf, target->width, target->height);
+        draw_list_record_range(list, first, end, render_pass, cmd_buf, app->instances.buffer,
+                               app->frame_data.buffer, target->instance_offset, NULL, stats);
+        SDL_EndGPURenderPass(render_pass);
+    }
+
+    // slices are handed out in order, so the one before is already being
+    // recorded and this never waits on a slice nobody picked up
+    SDL_LockMutex(queue->lock);
+    while (queue->next_submit != index) {
+        SDL_WaitCondition(queue->submitted, queue->lock);
+    }
+    if (cmd_buf) {
+        SDL_SubmitGPUCommandBuffer(cmd_buf);
+    }
+    queue->next_submit++;
+    SDL_BroadcastCondition(queue->submitted);
+    SDL_UnlockMutex(queue->lock);
+}
+
+// Records the sorted draw list in slices on the job pool. Everything the
+// slices read must already be submitted, and whatever reads the targets
+// afterwards has to go into a command buffer submitted after this returns.
+void record_draw_list_parallel(AppState *app, const RecordTarget *target, int slices)
+{
+    RecordQueue *queue = &app->record;
+    slices = SDL_clamp(slices, 1, RECORD_MAX_SLICES);
+    queue->next_submit = 0;
+
+    RecordJob job = {
+        .app = app,
+        .target = target,
+        .slices = slices,
+    };
+    jobs_parallel_for(&app->jobs, record_slice, &job, slices);
+
+    DrawStats *total = &app->draw_list.stats;
+    total->items = (Uint32) app->draw_list.count;
+    for (int i = 0; i < slices; i++) {
+        total->draws += queue->stats[i].draws;
+        total->binds += queue->stats[i].binds;
+        total->binds_skipped += queue->stats[i].binds_skipped;
+    }
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "common.h"
+
+bool record_queue_init(RecordQueue *queue);
+void record_queue_release(RecordQueue *queue);
+
+int  record_slice_count(const AppState *app, int item_count);
+void record_draw_list_parallel(AppState *app, const RecordTarget *target, int slices);
@@ -0,0 +1,363 @@
+#include "rendergraph.h"
+#include "rtpool.h"
+
+void render_graph_begin(RenderGraph *graph)
+{
+    graph->pass_count = 0;
+    graph->resource_count = 0;
+    graph->texture_count = 0;
+    SDL_zero(graph->stats);
+}
+
+static int add_resource(RenderGraph *graph, const char *name)
+{
+    if (graph->resource_count == RENDER_GRAPH_MAX_RESOURCES) {
+        SDL_Log("render graph: too many resources, dropping %s", name);
+        return -1;
+    }
+
+    int index = graph->resource_count++;
+    GraphResource *resource = &graph->resources[index];
+    SDL_zerop(resource);
+    resource->name = name;
+    resource->first_pass = -1;
+    resource->last_pass = -1;
+    resource->physical = -1;
+    return index;
+}
+
+// A texture the graph doesn't own, e.g. the swapchain or one that has to
+// survive the frame. Exported ones are stored after their last write.
+int render_graph_import(RenderGraph *graph, const char *name, SDL_GPUTexture *texture, bool exported)
+{
+    int index = add_resource(graph, name);
+    if (index < 0) return -1;
+
+    graph->resources[index].texture = texture;
+    graph->resources[index].imported = true;
+    graph->resources[index].exported = exported;
+    return index;
+}
+
+// A texture that only lives within the frame, backed by a pooled one
+int render_graph_create(RenderGraph *graph, const char *name, const RenderTargetDesc *desc)
+{
+    int index = add_resource(graph, name);
+    if (index < 0) return -1;
+
+    graph->resources[index].desc = *desc;
+    return index;
+}
+
+// Keeps a transient texture's contents for use after render_graph_execute,
+// until the next render_graph_compile
+void render_graph_export(RenderGraph *graph, int resource)
+{
+    if (resource < 0) return;
+    graph->resources[resource].exported = true;
+}
+
+// Passes run in the order they are added, so a pass only sees what the
+// passes added before it wrote.
+int render_graph_add_pass(RenderGraph *graph, const char *name, GraphPassType type,
+                          GraphExecuteFunc execute, void *userdata)
+{
+    if (graph->pass_count == RENDER_GRAPH_MAX_PASSES) {
+        SDL_Log("render graph: too many passes, dropping %s", name);
+        return -1;
+    }
+
+    int index = graph->pass_count++;
+    GraphPass *pass = &graph->passes[index];
+    SDL_zerop(pass);
+    pass->name = name;
+    pass->type = type;
+    pass->execute = execute;
+    pass->userdata = userdata;
+    return index;
+}
+
+void render_graph_keep(RenderGraph *graph, int pass)
+{
+    if (pass < 0) return;
+    graph->passes[pass].keep = true;
+}
+
+static void add_access(RenderGraph *graph, int pass, int resource, GraphAccessType type,
+                       bool clear, SDL_FColor clear_color)
+{
+    if (pass < 0 || resource < 0) return;
+
+    GraphPass *p = &graph->passes[pass];
+    if (p->access_count == RENDER_GRAPH_MAX_ACCESSES) {
+        SDL_Log("render graph: too many accesses in %s, dropping %s", p->name, graph->resources[resource].name);
+        return;
+    }
+    p->accesses[p->access_count++] = (GraphAccess) {
+        .type = type,
+        .resource = resource,
+        .clear = clear,
+        .clear_color = clear_color,
+    };
+}
+
+void render_graph_read(RenderGraph *graph, int pass, int resource)
+{
+    add_access(graph, pass, resource, GRAPH_ACCESS_READ, false, (SDL_FColor) { 0 });
+}
+
+void render_graph_write(RenderGraph *graph, int pass, int resource)
+{
+    add_access(graph, pass, resource, GRAPH_ACCESS_WRITE, false, (SDL_FColor) { 0 });
+}
+
+// A clear_color clears and discards what earlier passes wrote, NULL loads
+// it, which is undefined when nothing wrote it
+void render_graph_color(RenderGraph *graph, int pass, int resource, const SDL_FColor *clear_color)
+{
+    add_access(graph, pass, resource, GRAPH_ACCESS_COLOR, clear_color != NULL,
+               clear_color ? *clear_color : (SDL_FColor) { 0 });
+}
+
+// clears to the far plane, 1, discarding what earlier passes wrote
+void render_graph_depth(RenderGraph *graph, int pass, int resource, bool clear)
+{
+    add_access(graph, pass, resource, GRAPH_ACCESS_DEPTH, clear, (SDL_FColor) { 0 });
+}
+
+// whole writes and clears discard the previous contents
+static bool overwrites(const GraphAccess *access)
+{
+    return access->type == GRAPH_ACCESS_WRITE || (access->type != GRAPH_ACCESS_READ && access->clear);
+}
+
+// Walks back from the exported resources: a pass survives if it is kept or
+// writes something a surviving pass after it still needs.
+static void cull_passes(RenderGraph *graph)
+{
+    bool needed[RENDER_GRAPH_MAX_RESOURCES];
+    for (int r = 0; r < graph->resource_count; r++) {
+        needed[r] = graph->resources[r].exported;
+    }
+
+    for (int p = graph->pass_count - 1; p >= 0; p--) {
+        GraphPass *pass = &graph->passes[p];
+        pass->live = pass->keep;
+        for (int a = 0; a < pass->access_count; a++) {
+            const GraphAccess *access = &pass->accesses[a];
+            if (access->type != GRAPH_ACCESS_READ && needed[access->resource]) {
+                pass->live = true;
+            }
+        }
+        if (!pass->live) continue;
+
+        // an overwrite makes what came before dead, reads and attachments
+        // that load need it
+        for (int a = 0; a < pass->access_count; a++) {
+            if (overwrites(&pass->accesses[a])) {
+                needed[pass->accesses[a].resource] = false;
+            }
+        }
+        for (int a = 0; a < pass->access_count; a++) {
+            if (!overwrites(&pass->accesses[a])) {
+                needed[pass->accesses[a].resource] = true;
+            }
+        }
+    }
+}
+
+static bool same_desc(const RenderTargetDesc *a, const RenderTargetDesc *b)
+{
+    return SDL_memcmp(a, b, sizeof(RenderTargetDesc)) == 0;
+}
+
+// First fit over the targets taken this frame: one is free for a resource
+// once the last pass of everything it backed runs before the resource's
+// first, a new one comes from the pool otherwise.
+static bool assign_texture(SDL_GPUDevice *gpu, RenderGraph *graph, RenderTargetPool *pool, GraphResource *resource)
+{
+    for (int t = 0; t < graph->texture_count; t++) {
+        GraphTexture *texture = &graph->textures[t];
+        if (!same_desc(&texture->desc, &resource->desc)) continue;
+        if (texture->last_pass >= resource->first_pass) continue;
+
+        graph->stats.aliased++;
+        texture->last_pass = resource->last_pass;
+        resource->physical = t;
+        resource->texture = texture->texture;
+        return true;
+    }
+
+    if (graph->texture_count == RENDER_GRAPH_MAX_TEXTURES) {
+        SDL_Log("render graph: too many textures, can't back %s", resource->name);
+        return false;
+    }
+
+    SDL_GPUTexture *created = rt_pool_acquire(gpu, pool, &resource->desc, resource->name);
+    if (!created) return false;
+
+    int t = graph->texture_count++;
+    graph->textures[t] = (GraphTexture) {
+        .desc = resource->desc,
+        .texture = created,
+        .last_pass = resource->last_pass,
+    };
+    resource->physical = t;
+    resource->texture = created;
+    return true;
+}
+
+// Culls passes, works out lifetimes and backs every used transient with a
+// target from the pool. Call once per frame, after the passes are declared.
+bool render_graph_compile(SDL_GPUDevice *gpu, RenderGraph *graph, RenderTargetPool *pool)
+{
+    cull_passes(graph);
+
+    for (int p = 0; p < graph->pass_count; p++) {
+        const GraphPass *pass = &graph->passes[p];
+        if (!pass->live) {
+            graph->stats.culled++;
+            continue;
+        }
+        graph->stats.passes++;
+
+        for (int a = 0; a < pass->access_count; a++) {
+            GraphResource *resource = &graph->resources[pass->accesses[a].resource];
+            if (resource->first_pass < 0) resource->first_pass = p;
+            resource->last_pass = p;
+        }
+    }
+
+    bool ok = true;
+    for (int p = 0; p < graph->pass_count; p++) {
+        for (int r = 0; r < graph->resource_count; r++) {
+            GraphResource *resource = &graph->resources[r];
+            if (resource->imported || resource->first_pass != p) continue;
+
+            // exported contents outlive every pass
+            if (resource->exported) resource->last_pass = graph->pass_count;
+            graph->stats.transient++;
+            if (!assign_texture(gpu, graph, pool, resource)) ok = false;
+        }
+    }
+    graph->stats.textures = (Uint32) graph->texture_count;
+    return ok;
+}
+
+static const GraphAccess *find_access(const GraphPass *pass, int resource)
+{
+    for (int a = 0; a < pass->access_count; a++) {
+        if (pass->accesses[a].resource == resource) return &pass->accesses[a];
+    }
+    return NULL;
+}
+
+SDL_GPUTexture *render_graph_texture(const RenderGraph *graph, int resource)
+{
+    return resource >= 0 ? graph->resources[resource].texture : NULL;
+}
+
+// CLEAR if asked for, otherwise LOAD when a surviving pass wrote it earlier
+// this frame or it comes from outside the graph, DONT_CARE if neither
+SDL_GPULoadOp render_graph_load_op(const RenderGraph *graph, int pass, int resource)
+{
+    if (pass < 0 || resource < 0) return SDL_GPU_LOADOP_DONT_CARE;
+
+    const GraphAccess *access = find_access(&graph->passes[pass], resource);
+    if (access && access->clear) return SDL_GPU_LOADOP_CLEAR;
+
+    for (int p = 0; p < pass; p++) {
+        if (!graph->passes[p].live) continue;
+        const GraphAccess *earlier = find_access(&graph->passes[p], resource);
+        if (earlier && earlier->type != GRAPH_ACCESS_READ) return SDL_GPU_LOADOP_LOAD;
+    }
+    return graph->resources[resource].imported ? SDL_GPU_LOADOP_LOAD : SDL_GPU_LOADOP_DONT_CARE;
+}
+
+// STORE when the next surviving pass touching it reads or loads it, or
+// nothing does and it is exported
+SDL_GPUStoreOp render_graph_store_op(const RenderGraph *graph, int pass, int resource)
+{
+    if (pass < 0 || resource < 0) return SDL_GPU_STOREOP_DONT_CARE;
+
+    for (int p = pass + 1; p < graph->pass_count; p++) {
+        if (!graph->passes[p].live) continue;
+        const GraphAccess *access = find_access(&graph->passes[p], resource);
+        if (!access) continue;
+        return overwrites(access) ? SDL_GPU_STOREOP_DONT_CARE : SDL_GPU_STOREOP_STORE;
+    }
+    return graph->resources[resource].exported ? SDL_GPU_STOREOP_STORE : SDL_GPU_STOREOP_DONT_CARE;
+}
+
+static void begin_render_pass(GraphContext *ctx, const GraphPass *pass)
+{
+    // pool targets are idle on the gpu when handed out, so nothing is cycled
+    const RenderGraph *graph = ctx->graph;
+    SDL_GPUColorTargetInfo color_targets[RENDER_GRAPH_MAX_ACCESSES];
+    SDL_GPUDepthStencilTargetInfo depth_target;
+    Uint32 color_count = 0;
+    bool has_depth = false;
+
+    for (int a = 0; a < pass->access_count; a++) {
+        const GraphAccess *access = &pass->accesses[a];
+        SDL_GPULoadOp load_op = render_graph_load_op(graph, ctx->pass, access->resource);
+        SDL_GPUStoreOp store_op = render_graph_store_op(graph, ctx->pass, access->resource);
+
+        if (access->type == GRAPH_ACCESS_COLOR) {
+            color_targets[color_count++] = (SDL_GPUColorTargetInfo) {
+                .texture = graph->resources[access->resource].texture,
+                .clear_color = access->clear_color,
+                .load_op = load_op,
+                .store_op = store_op,
+            };
+        } else if (access->type == GRAPH_ACCESS_DEPTH) {
+            depth_target = (SDL_GPUDepthStencilTargetInfo) {
+                .texture = graph->resources[access->resource].texture,
+                .clear_depth = 1,
+                .load_op = load_op,
+                .store_op = store_op,
+                .stencil_load_op = SDL_GPU_LOADOP_DONT_CARE,
+                .stencil_store_op = SDL_GPU_STOREOP_DONT_CARE,
+            };
+            has_depth = true;
+        }
+    }
+
+    ctx->render_pass = SDL_BeginGPURenderPass(ctx->cmd_buf, color_targets, color_count,
+                                              has_depth ? &depth_target : NULL);
+}
+
+// Runs the surviving passes in order. Returns the command buffer the last
+// pass left in the context, NULL if a custom pass lost it.
+SDL_GPUCommandBuffer *render_graph_execute(AppState *app, RenderGraph *graph, SDL_GPUCommandBuffer *cmd_buf)
+{
+    GraphContext ctx = {
+        .app = app,
+        .graph = graph,
+        .cmd_buf = cmd_buf,
+    };
+
+    for (int p = 0; p < graph->pass_count && ctx.cmd_buf; p++) {
+        const GraphPass *pass = &graph->passes[p];
+        if (!pass->live) continue;
+
+        ctx.pass = p;
+        ctx.render_pass = NULL;
+        if (pass->type == GRAPH_PASS_RENDER) {
+            begin_render_pass(&ctx, pass);
+            if (!ctx.render_pass) {
+                SDL_Log("render graph: failed to begin %s\n%s", pass->name, SDL_GetError());
+                continue;
+            }
+        }
+
+        if (pass->execute) {
+            pass->execute(&ctx, pass->userdata);
+        }
+
+        if (ctx.render_pass) {
+            SDL_EndGPURenderPass(ctx.render_pass);
+        }
+    }
+    return ctx.cmd_buf;
+}
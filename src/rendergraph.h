@@ -0,0 +1,24 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "common.h"
+
+void render_graph_begin(RenderGraph *graph);
+int  render_graph_import(RenderGraph *graph, const char *name, SDL_GPUTexture *texture, bool exported);
+int  render_graph_create(RenderGraph *graph, const char *name, const RenderTargetDesc *desc);
+void render_graph_export(RenderGraph *graph, int resource);
+
+int  render_graph_add_pass(RenderGraph *graph, const char *name, GraphPassType type,
+                           GraphExecuteFunc execute, void *userdata);
+void render_graph_keep(RenderGraph *graph, int pass);
+void render_graph_read(RenderGraph *graph, int pass, int resource);
+void render_graph_write(RenderGraph *graph, int pass, int resource);
+void render_graph_color(RenderGraph *graph, int pass, int resource, const SDL_FColor *clear_color);
+void render_graph_depth(RenderGraph *graph, int pass, int resource, bool clear);
+
+bool render_graph_compile(SDL_GPUDevice *gpu, RenderGraph *graph, RenderTargetPool *pool);
+SDL_GPUCommandBuffer *render_graph_execute(AppState *app, RenderGraph *graph, SDL_GPUCommandBuffer *cmd_buf);
+
+SDL_GPUTexture *render_graph_texture(const RenderGraph *graph, int resource);
+SDL_GPULoadOp   render_graph_load_op(const RenderGraph *graph, int pass, int resource);
+SDL_GPUStoreOp  render_graph_store_op(const RenderGraph *graph, int pass, int resource);
@@ -0,0 +1,119 @@
+#include "rtpool.h"
+#include "gpumem.h"
+
+void rt_pool_init(RenderTargetPool *pool)
+{
+    SDL_zerop(pool);
+    pool->frame = 1;
+}
+
+// Only call once the gpu is idle
+void rt_pool_release(SDL_GPUDevice *gpu, RenderTargetPool *pool)
+{
+    for (int i = 0; i < pool->fence_count; i++) {
+        if (pool->fences[i].fence) SDL_ReleaseGPUFence(gpu, pool->fences[i].fence);
+    }
+    for (int i = 0; i < pool->count; i++) {
+        gpumem_release_texture(gpu, pool->targets[i].texture);
+    }
+    SDL_zerop(pool);
+}
+
+// Sizes are rounded up so a window resized a few pixels at a time keeps
+// its targets, the scene only renders to the window sized corner anyway.
+Uint32 rt_pool_size(Uint32 size)
+{
+    return SDL_max((size + RT_POOL_SIZE_STEP - 1) / RT_POOL_SIZE_STEP * RT_POOL_SIZE_STEP, RT_POOL_SIZE_STEP);
+}
+
+static void drop_fence(SDL_GPUDevice *gpu, RenderTargetPool *pool)
+{
+    RenderTargetFence *oldest = &pool->fences[0];
+    if (oldest->fence) SDL_ReleaseGPUFence(gpu, oldest->fence);
+    pool->completed = SDL_max(pool->completed, oldest->frame);
+    pool->fence_count--;
+    SDL_memmove(pool->fences, pool->fences + 1, (size_t) pool->fence_count * sizeof(RenderTargetFence));
+}
+
+// Finds out which frames the gpu finished, never waits. Submissions run in
+// order, so a signaled fence also completes the fence-less frames before it.
+void rt_pool_begin_frame(SDL_GPUDevice *gpu, RenderTargetPool *pool)
+{
+    int done = 0;
+    for (int i = 0; i < pool->fence_count; i++) {
+        if (pool->fences[i].fence && SDL_QueryGPUFence(gpu, pool->fences[i].fence)) done = i + 1;
+    }
+    while (done-- > 0) {
+        drop_fence(gpu, pool);
+    }
+
+    for (int i = 0; i < pool->count; i++) {
+        RenderTarget *target = &pool->targets[i];
+        if (target->last_frame > pool->completed) continue;
+        if (target->last_frame + RT_POOL_RETIRE_FRAMES > pool->frame) continue;
+
+        gpumem_release_texture(gpu, target->texture);
+        pool->targets[i--] = pool->targets[--pool->count];
+        pool->stats.released++;
+    }
+    pool->stats.targets = (Uint32) pool->count;
+}
+
+// Takes the fence of the frame's last submit, whatever the frame acquired
+// is free again once it signals. fence may be NULL.
+void rt_pool_end_frame(SDL_GPUDevice *gpu, RenderTargetPool *pool, SDL_GPUFence *fence)
+{
+    // more frames in flight than ever expected, let the oldest finish
+    if (pool->fence_count == RT_POOL_MAX_FRAMES) {
+        if (pool->fences[0].fence) SDL_WaitForGPUFences(gpu, true, &pool->fences[0].fence, 1);
+        drop_fence(gpu, pool);
+    }
+
+    pool->fences[pool->fence_count++] = (RenderTargetFence) {
+        .fence = fence,
+        .frame = pool->frame,
+    };
+    pool->frame++;
+}
+
+// A target matching desc that no unfinished frame uses, created when there
+// is none. Each target is handed out once per frame.
+SDL_GPUTexture *rt_pool_acquire(SDL_GPUDevice *gpu, RenderTargetPool *pool, const RenderTargetDesc *desc,
+                                const char *name)
+{
+    for (int i = 0; i < pool->count; i++) {
+        RenderTarget *target = &pool->targets[i];
+        if (target->last_frame > pool->completed) continue;
+        if (SDL_memcmp(&target->desc, desc, sizeof(RenderTargetDesc)) != 0) continue;
+
+        target->last_frame = pool->frame;
+        return target->texture;
+    }
+
+    if (pool->count == RT_POOL_MAX_TARGETS) {
+        SDL_Log("render target pool full, can't create %s", name);
+        return NULL;
+    }
+
+    SDL_GPUTextureCreateInfo createinfo = {
+        .type = SDL_GPU_TEXTURETYPE_2D,
+        .format = desc->format,
+        .usage = desc->usage,
+        .width = desc->width,
+        .height = desc->height,
+        .layer_count_or_depth = 1,
+        .num_levels = SDL_max(desc->num_levels, 1),
+        .sample_count = desc->sample_count,
+    };
+    SDL_GPUTexture *texture = gpumem_create_texture(gpu, &createinfo, GPU_MEM_RENDER_TARGET, name);
+    if (!texture) return NULL;
+
+    pool->targets[pool->count++] = (RenderTarget) {
+        .desc = *desc,
+        .texture = texture,
+        .last_frame = pool->frame,
+    };
+    pool->stats.created++;
+    pool->stats.targets = (Uint32) pool->count;
+    return texture;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "common.h"
+
+void rt_pool_init(RenderTargetPool *pool);
+void rt_pool_release(SDL_GPUDevice *gpu, RenderTargetPool *pool);
+
+void rt_pool_begin_frame(SDL_GPUDevice *gpu, RenderTargetPool *pool);
+void rt_pool_end_frame(SDL_GPUDevice *gpu, RenderTargetPool *pool, SDL_GPUFence *fence);
+
+SDL_GPUTexture *rt_pool_acquire(SDL_GPUDevice *gpu, RenderTargetPool *pool, const RenderTargetDesc *desc,
+                                const char *name);
+Uint32 rt_pool_size(Uint32 size);
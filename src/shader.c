@@ -1,7 +1,60 @@
 #include "shader.h"
 #include "lib/cJSON.h"
 
-SDL_GPUShader *LoadShader(SDL_GPUDevice *device, const char *shaderfile)
+static SDL_GPUShaderFormat pick_shader_format(SDL_GPUDevice *device, const char **format_ext, const char **entrypoint)
+{
+    *entrypoint = "main";
+
+    SDL_GPUShaderFormat supported_formats = SDL_GetGPUShaderFormats(device);
+    if (supported_formats & SDL_GPU_SHADERFORMAT_SPIRV) {
+        *format_ext = "spv";
+        return SDL_GPU_SHADERFORMAT_SPIRV;
+    } else if (supported_formats & SDL_GPU_SHADERFORMAT_DXIL) {
+        *format_ext = "dxil";
+        return SDL_GPU_SHADERFORMAT_DXIL;
+    } else if (supported_formats & SDL_GPU_SHADERFORMAT_MSL) {
+        *format_ext = "msl";
+        *entrypoint = "main0";
+        return SDL_GPU_SHADERFORMAT_MSL;
+    }
+
+    SDL_LogCritical(SDL_LOG_CATEGORY_GPU, "No supported shader format: %u", supported_formats);
+    return SDL_GPU_SHADERFORMAT_INVALID;
+}
+
+// Finds the code and reflection for a shader, in the pack when there is
+// one, otherwise in the loose files. *owned is set when the caller has to
+// SDL_free the returned code.
+static const Uint8 *find_shader_code(const ShaderPack *pack, const char *shaderfile,
+                                     SDL_GPUShaderFormat format, const char *format_ext,
+                                     size_t *code_size, ShaderInfo *info, void **owned)
+{
+    *owned = NULL;
+
+    // the pack holds code and reflection already parsed, no file access needed
+    const ShaderPackEntry *entry = shader_pack_find(pack, shaderfile, format);
+    if (entry) {
+        *code_size = entry->size;
+        *info = entry->info;
+        return pack->data + entry->offset;
+    }
+
+    char pathbuffer[256], filename[256];
+    SDL_snprintf(pathbuffer, sizeof(pathbuffer), "assets/shaders/out/%s", shaderfile);
+    SDL_snprintf(filename, sizeof(filename), "%s.%s", pathbuffer, format_ext);
+
+    void *code = SDL_LoadFile(filename, code_size);
+    if (!code) {
+        SDL_Log("Failed to load shader file: %s", shaderfile);
+        return NULL;
+    }
+
+    *info = load_shader_info(pathbuffer);
+    *owned = code;
+    return code;
+}
+
+SDL_GPUShader *LoadShader(SDL_GPUDevice *device, const ShaderPack *pack, const char *shaderfile)
 {
     SDL_GPUShaderStage stage;
 
@@ -14,41 +67,24 @@ SDL_GPUShader *LoadShader(SDL_GPUDevice *device, const char *shaderfile)
         return false;
     }
 
-    SDL_GPUShaderFormat format;
-    char *format_ext = NULL;
-    const char *entrypoint = "main";
-
-    SDL_GPUShaderFormat supported_formats = SDL_GetGPUShaderFormats(device);
-    if (supported_formats & SDL_GPU_SHADERFORMAT_SPIRV) {
-        format = SDL_GPU_SHADERFORMAT_SPIRV;
-        format_ext = "spv";
-    } else if (supported_formats & SDL_GPU_SHADERFORMAT_DXIL) {
-        format = SDL_GPU_SHADERFORMAT_DXIL;
-        format_ext = "dxil";
-    } else if (supported_formats & SDL_GPU_SHADERFORMAT_MSL) {
-        format = SDL_GPU_SHADERFORMAT_MSL;
-        format_ext = "msl";
-        entrypoint = "main0";
-    } else {
-        SDL_LogCritical(SDL_LOG_CATEGORY_GPU, "No supported shader format: %u", supported_formats);
+    const char *format_ext = NULL;
+    const char *entrypoint = NULL;
+    SDL_GPUShaderFormat format = pick_shader_format(device, &format_ext, &entrypoint);
+    if (format == SDL_GPU_SHADERFORMAT_INVALID) {
+        return NULL;
     }
 
-    char pathbuffer[256], filename[256];
-    SDL_snprintf(pathbuffer, sizeof(pathbuffer), "assets/shaders/out/%s", shaderfile);
-    SDL_snprintf(filename, sizeof(filename), "%s.%s", pathbuffer, format_ext);
-    
     size_t codesize;
-    void *code = SDL_LoadFile(filename, &codesize);
+    ShaderInfo info;
+    void *owned;
+    const Uint8 *code = find_shader_code(pack, shaderfile, format, format_ext, &codesize, &info, &owned);
     if (!code) {
-        SDL_Log("Failed to load shader file: %s", shaderfile);
         return NULL;
     }
 
-    ShaderInfo info = load_shader_info(pathbuffer);
-
     SDL_GPUShaderCreateInfo shader_createinfo = {
         .code_size = codesize,
-        .code = (Uint8 *) code,
+        .code = code,
         .entrypoint = entrypoint,
         .format = format,
         .stage = stage,
@@ -59,11 +95,55 @@ SDL_GPUShader *LoadShader(SDL_GPUDevice *device, const char *shaderfile)
     };
     SDL_GPUShader *shader = SDL_CreateGPUShader(device, &shader_createinfo);
     
-    SDL_free(code);
+    SDL_free(owned);
 
     return shader;
 }
 
+SDL_GPUComputePipeline *LoadComputePipeline(SDL_GPUDevice *device, const ShaderPack *pack, const char *shaderfile)
+{
+    if (!SDL_strstr(shaderfile, ".comp")) {
+        SDL_Log("Invalid filename for a compute shader: %s", shaderfile);
+        return NULL;
+    }
+
+    const char *format_ext = NULL;
+    const char *entrypoint = NULL;
+    SDL_GPUShaderFormat format = pick_shader_format(device, &format_ext, &entrypoint);
+    if (format == SDL_GPU_SHADERFORMAT_INVALID) {
+        return NULL;
+    }
+
+    size_t codesize;
+    ShaderInfo info;
+    void *owned;
+    const Uint8 *code = find_shader_code(pack, shaderfile, format, format_ext, &codesize, &info, &owned);
+    if (!code) {
+        return NULL;
+    }
+
+    SDL_GPUComputePipelineCreateInfo pipeline_createinfo = {
+        .code_size = codesize,
+        .code = code,
+        .entrypoint = entrypoint,
+        .format = format,
+        .num_samplers = info.num_samplers,
+        .num_readonly_storage_textures = info.num_readonly_storage_textures,
+        .num_readonly_storage_buffers = info.num_readonly_storage_buffers,
+        .num_readwrite_storage_textures = info.num_readwrite_storage_textures,
+        .num_readwrite_storage_buffers = info.num_readwrite_storage_buffers,
+        .num_uniform_buffers = info.num_uniform_buffers,
+        .threadcount_x = info.threadcount_x,
+        .threadcount_y = info.threadcount_y,
+        .threadcount_z = info.threadcount_z,
+    };
+    SDL_GPUComputePipeline *pipeline = SDL_CreateGPUComputePipeline(device, &pipeline_createinfo);
+
+    SDL_free(owned);
+
+    return pipeline;
+}
+
 ShaderInfo load_shader_info(const char *shaderfile)
 {
     ShaderInfo info = {0};
@@ -94,9 +174,118 @@ ShaderInfo load_shader_info(const char *shaderfile)
     info.num_storage_buffers  = JSON_GET_UINT(json, "storage_buffers");
     info.num_uniform_buffers  = JSON_GET_UINT(json, "uniform_buffers");
 
+    info.num_readonly_storage_textures  = JSON_GET_UINT(json, "readonly_storage_textures");
+    info.num_readonly_storage_buffers   = JSON_GET_UINT(json, "readonly_storage_buffers");
+    info.num_readwrite_storage_textures = JSON_GET_UINT(json, "readwrite_storage_textures");
+    info.num_readwrite_storage_buffers  = JSON_GET_UINT(json, "readwrite_storage_buffers");
+    info.threadcount_x = JSON_GET_UINT(json, "threadcount_x");
+    info.threadcount_y = JSON_GET_UINT(json, "threadcount_y");
+    info.threadcount_z = JSON_GET_UINT(json, "threadcount_z");
+
     cJSON_Delete(json);
     SDL_free(file_data);
 
     return info;
 }
 
+// "shader.vert" + features -> "shader.04.vert"
+void shader_variant_name(char *dest, size_t len, const char *shaderfile, Uint32 features)
+{
+    const char *stage = SDL_strrchr(shaderfile, '.');
+    if (!stage) {
+        SDL_strlcpy(dest, shaderfile, len);
+        return;
+    }
+
+    if (SDL_strcmp(stage, ".vert") == 0) {
+        features &= SHADER_VERTEX_FEATURES;
+    } else if (SDL_strcmp(stage, ".frag") == 0) {
+        features &= SHADER_FRAGMENT_FEATURES;
+    }
+
+    SDL_snprintf(dest, len, "%.*s.%02x%s", (int) (stage - shaderfile), shaderfile, features, stage);
+}
+
+// FNV-1a
+Uint32 shader_name_hash(const char *name)
+{
+    Uint32 hash = 2166136261u;
+    for (const char *c = name; *c; c++) {
+        hash ^= (Uint8) *c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool shader_pack_open(ShaderPack *pack, const char *path)
+{
+    SDL_zerop(pack);
+
+    size_t size = 0;
+    Uint8 *data = SDL_LoadFile(path, &size);
+    if (!data) {
+        return false;
+    }
+
+    const ShaderPackHeader *header = (const ShaderPackHeader *) data;
+    if (size < sizeof(*header) || header->magic != SHADER_PACK_MAGIC || header->version != SHADER_PACK_VERSION) {
+        SDL_Log("Invalid shader pack: %s", path);
+        SDL_free(data);
+        return false;
+    }
+
+    size_t table_end = sizeof(*header) + (size_t) header->entry_count * sizeof(ShaderPackEntry);
+    if (table_end > size) {
+        SDL_Log("Truncated shader pack: %s", path);
+        SDL_free(data);
+        return false;
+    }
+
+    const ShaderPackEntry *entries = (const ShaderPackEntry *) (data + sizeof(*header));
+    for (Uint32 i = 0; i < header->entry_count; i++) {
+        if ((size_t) entries[i].offset + entries[i].size > size) {
+            SDL_Log("Corrupt shader pack entry %s in %s", entries[i].name, path);
+            SDL_free(data);
+            return false;
+        }
+    }
+
+    pack->data = data;
+    pack->size = size;
+    pack->entries = entries;
+    pack->entry_count = header->entry_count;
+    return true;
+}
+
+void shader_pack_close(ShaderPack *pack)
+{
+    SDL_free(pack->data);
+    SDL_zerop(pack);
+}
+
+const ShaderPackEntry *shader_pack_find(const ShaderPack *pack, const char *name, SDL_GPUShaderFormat format)
+{
+    if (!pack || !pack->entry_count) return NULL;
+
+    Uint32 hash = shader_name_hash(name);
+
+    // lower bound on (name_hash, format)
+    Uint32 lo = 0, hi = pack->entry_count;
+    while (lo < hi) {
+        Uint32 mid = lo + (hi - lo) / 2;
+        const ShaderPackEntry *entry = &pack->entries[mid];
+        if (entry->name_hash < hash || (entry->name_hash == hash && entry->format < format)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (; lo < pack->entry_count && pack->entries[lo].name_hash == hash; lo++) {
+        const ShaderPackEntry *entry = &pack->entries[lo];
+        if (entry->format == format && SDL_strcmp(entry->name, name) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
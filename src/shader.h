@@ -2,13 +2,75 @@
 
 #include <SDL3/SDL.h>
 
+#define SHADER_PACK_PATH    "assets/shaders/shaders.pack"
+#define SHADER_PACK_MAGIC   SDL_FOURCC('S', 'P', 'A', 'K')
+#define SHADER_PACK_VERSION 2
+#define SHADER_NAME_LEN     64
+
+// Build-time permutations, see $permutations in build.ps1. Each stage is
+// only compiled for the bits it actually uses, the rest are masked off.
+typedef enum {
+    SHADER_FEATURE_TEXTURED     = 1 << 0,
+    SHADER_FEATURE_VERTEX_COLOR = 1 << 1,
+    SHADER_FEATURE_INSTANCED    = 1 << 2,
+    SHADER_FEATURE_ALPHA_TEST   = 1 << 3,
+    SHADER_FEATURE_GPU_CULLED   = 1 << 4,
+    SHADER_FEATURE_DEPTH_ONLY   = 1 << 5,
+    SHADER_FEATURE_LIT          = 1 << 6,
+} ShaderFeature;
+
+#define SHADER_VERTEX_FEATURES   (SHADER_FEATURE_INSTANCED | SHADER_FEATURE_GPU_CULLED | SHADER_FEATURE_DEPTH_ONLY | \
+                                  SHADER_FEATURE_LIT)
+#define SHADER_FRAGMENT_FEATURES (SHADER_FEATURE_TEXTURED | SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_ALPHA_TEST | \
+                                  SHADER_FEATURE_LIT)
+
 typedef struct {
     Uint32 num_samplers;
     Uint32 num_storage_textures;
     Uint32 num_storage_buffers;
     Uint32 num_uniform_buffers;
+    // compute only
+    Uint32 num_readonly_storage_textures;
+    Uint32 num_readonly_storage_buffers;
+    Uint32 num_readwrite_storage_textures;
+    Uint32 num_readwrite_storage_buffers;
+    Uint32 threadcount_x;
+    Uint32 threadcount_y;
+    Uint32 threadcount_z;
 } ShaderInfo;
 
-SDL_GPUShader *LoadShader(SDL_GPUDevice *device, const char *shaderfile);
+// On-disk layout of a shader pack: a header, a table of entries sorted by
+// (name_hash, format) and the shader blobs, each 16-byte aligned. Every
+// field is 32 bits wide so the file can be used in place once loaded.
+typedef struct {
+    Uint32 magic;
+    Uint32 version;
+    Uint32 entry_count;
+    Uint32 reserved;
+} ShaderPackHeader;
+
+typedef struct {
+    char name[SHADER_NAME_LEN];  // e.g. "shader.vert"
+    Uint32 name_hash;
+    Uint32 format;               // SDL_GPUShaderFormat
+    Uint32 offset;               // from start of file
+    Uint32 size;
+    ShaderInfo info;
+} ShaderPackEntry;
+
+typedef struct {
+    Uint8 *data;
+    size_t size;
+    const ShaderPackEntry *entries;
+    Uint32 entry_count;
+} ShaderPack;
+
+SDL_GPUShader *LoadShader(SDL_GPUDevice *device, const ShaderPack *pack, const char *shaderfile);
+SDL_GPUComputePipeline *LoadComputePipeline(SDL_GPUDevice *device, const ShaderPack *pack, const char *shaderfile);
 ShaderInfo load_shader_info(const char *shaderfile);
+void shader_variant_name(char *dest, size_t len, const char *shaderfile, Uint32 features);
 
+Uint32 shader_name_hash(const char *name);
+bool shader_pack_open(ShaderPack *pack, const char *path);
+void shader_pack_close(ShaderPack *pack);
+const ShaderPackEntry *shader_pack_find(const ShaderPack *pack, const char *name, SDL_GPUShaderFormat format);
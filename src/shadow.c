@@ -0,0 +1,179 @@
+#include "shadow.h"
+#include "game.h"
+#include "gpu.h"
+#include "instances.h"
+#include "pipeline.h"
+
+bool shadow_init(AppState *app)
+{
+    ShadowCache *shadow = &app->shadow;
+
+    PipelineDesc desc = pipeline_desc_default(app);
+    desc.vertex_layout = VERTEX_LAYOUT_POSITION;
+    desc.num_color_targets = 0;
+    desc.color_format = SDL_GPU_TEXTUREFORMAT_INVALID;
+    desc.cull_mode = SDL_GPU_CULLMODE_NONE;
+    desc.depth_bias_constant = 2;
+    desc.depth_bias_slope = 2;
+    shader_variant_name(desc.vertex_shader, sizeof(desc.vertex_shader), "shader.vert",
+                        SHADER_FEATURE_INSTANCED | SHADER_FEATURE_DEPTH_ONLY);
+    SDL_strlcpy(desc.fragment_shader, "depth.frag", sizeof(desc.fragment_shader));
+    shadow->pipeline = pipeline_get(app, &desc);
+
+    SDL_GPUTextureCreateInfo texture_createinfo = {
+        .format = app->depth_texture_format,
+        .usage = SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET | SDL_GPU_TEXTUREUSAGE_SAMPLER,
+        .width = SHADOW_MAP_SIZE,
+        .height = SHADOW_MAP_SIZE,
+        .layer_count_or_depth = 1,
+        .num_levels = 1,
+    };
+    shadow->static_texture = gpumem_create_texture(app->gpu, &texture_createinfo, GPU_MEM_RENDER_TARGET, "shadow cache");
+
+    // lit where the reference is not behind the stored depth, filtered 2x2
+    SDL_GPUSamplerCreateInfo sampler_createinfo = {
+        .min_filter = SDL_GPU_FILTER_LINEAR,
+        .mag_filter = SDL_GPU_FILTER_LINEAR,
+        .mipmap_mode = SDL_GPU_SAMPLERMIPMAPMODE_NEAREST,
+        .address_mode_u = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE,
+        .address_mode_v = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE,
+        .address_mode_w = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE,
+        .compare_op = SDL_GPU_COMPAREOP_LESS_OR_EQUAL,
+        .enable_compare = true,
+    };
+    shadow->sampler = SDL_CreateGPUSampler(app->gpu, &sampler_createinfo);
+
+    if (!shadow->pipeline || !shadow->static_texture || !shadow->sampler) {
+        SDL_Log("Failed to set up the shadow map\n%s", SDL_GetError());
+        shadow_release(app);
+        return false;
+    }
+    return true;
+}
+
+void shadow_release(AppState *app)
+{
+    ShadowCache *shadow = &app->shadow;
+
+    // the pipeline belongs to the pipeline cache
+    gpumem_release_texture(app->gpu, shadow->static_texture);
+    SDL_ReleaseGPUSampler(app->gpu, shadow->sampler);
+    SDL_zerop(shadow);
+}
+
+// Writes the record indices of one set of casters grouped by model, first[m]
+// and count[m] index those of model m.
+static bool write_casters(AppState *app, bool static_casters, Uint32 first[MAX_MODELS], Uint32 count[MAX_MODELS])
+{
+    const EntityStore *entities = &app->snapshot.entities;
+
+    SDL_memset(count, 0, MAX_MODELS * sizeof(Uint32));
+    Uint32 total = 0;
+    for (int i = 0; i < entities->count; i++) {
+        if (((entities->flags[i] & ENTITY_STATIC) != 0) != static_casters) continue;
+        count[entities->model_id[i]]++;
+        total++;
+    }
+
+    Uint32 offset;
+    Uint32 *records = transient_buffer_alloc(&app->frame_data, SDL_max(total, 1) * sizeof(Uint32),
+                                             sizeof(Uint32), &offset);
+    if (!records) return false;
+
+    Uint32 next[MAX_MODELS];
+    Uint32 start = 0;
+    for (int m = 0; m < MAX_MODELS; m++) {
+        first[m] = offset / sizeof(Uint32) + start;
+        next[m] = start;
+        start += count[m];
+    }
+    for (int i = 0; i < entities->count; i++) {
+        if (((entities->flags[i] & ENTITY_STATIC) != 0) != static_casters) continue;
+        records[next[entities->model_id[i]]++] = instance_record(app, i);
+    }
+    return true;
+}
+
+// Decides whether the cache is stale and writes this frame's casters into
+// frame_data, the static ones only when the cache is rebuilt. Must be
+// called between transient begin and upload, after instances_write.
+bool shadow_write(AppState *app)
+{
+    ShadowCache *shadow = &app->shadow;
+    const RenderSnapshot *snap = &app->snapshot;
+
+    vec3 direction;
+    vec3_normalize_to(MOON_DIRECTION, direction);
+
+    mat4 view, proj;
+    vec3 eye, up = { 0, 0, 1 };
+    vec3_scale(direction, SHADOW_DISTANCE, eye);
+    lookat_lh(eye, VEC3_ZERO, up, view);
+    ortho_lh_zo(-SHADOW_EXTENT, SHADOW_EXTENT, -SHADOW_EXTENT, SHADOW_EXTENT, 0, 2 * SHADOW_DISTANCE, proj);
+    mat4_mul(proj, view, shadow->view_proj);
+
+    shadow->rebuild = !shadow->valid
+                   || shadow->static_version != snap->entities.static_version
+                   || SDL_memcmp(shadow->direction, direction, sizeof(vec3)) != 0;
+    if (shadow->rebuild) {
+        // valid again once the rebuild is recorded, see shadow_cached
+        shadow->valid = false;
+        if (!write_casters(app, true, shadow->static_first, shadow->static_count)) return false;
+        vec3_copy(direction, shadow->direction);
+        shadow->static_version = snap->entities.static_version;
+    }
+    if (!write_casters(app, false, shadow->dynamic_first, shadow->dynamic_count)) return false;
+
+    shadow->stats.dynamic_casters = 0;
+    for (int m = 0; m < MAX_MODELS; m++) {
+        shadow->stats.dynamic_casters += shadow->dynamic_count[m];
+    }
+    return true;
+}
+
+void shadow_draw(AppState *app, SDL_GPURenderPass *render_pass, SDL_GPUCommandBuffer *cmd_buf, bool static_casters)
+{
+    ShadowCache *shadow = &app->shadow;
+    const Uint32 *first = static_casters ? shadow->static_first : shadow->dynamic_first;
+    const Uint32 *count = static_casters ? shadow->static_count : shadow->dynamic_count;
+
+    FrameUniforms ubo = {0};
+    mat4_copy(shadow->view_proj, ubo.view_proj);
+    SDL_PushGPUVertexUniformData(cmd_buf, 0, &ubo, sizeof(ubo));
+
+    SDL_BindGPUGraphicsPipeline(render_pass, shadow->pipeline);
+    SDL_GPUBuffer *storage_buffers[] = { app->instances.buffer, app->frame_data.buffer };
+    SDL_BindGPUVertexStorageBuffers(render_pass, 0, storage_buffers, SDL_arraysize(storage_buffers));
+
+    for (int m = 0; m < app->model_count; m++) {
+        if (count[m] == 0) continue;
+
+        DrawUniforms draw = {
+            .instance_offset = first[m],
+        };
+        SDL_PushGPUVertexUniformData(cmd_buf, 1, &draw, sizeof(draw));
+
+        const Mesh *mesh = &app->models[m].mesh;
+        SDL_GPUBufferBinding vert_bindings = {
+            .buffer = mesh->vertex_buffer,
+        };
+        SDL_BindGPUVertexBuffers(render_pass, 0, &vert_bindings, 1);
+        SDL_GPUBufferBinding index_bindings = {
+            .buffer = mesh->index_buffer,
+        };
+        SDL_BindGPUIndexBuffer(render_pass, &index_bindings, SDL_GPU_INDEXELEMENTSIZE_16BIT);
+        SDL_DrawGPUIndexedPrimitives(render_pass, mesh->index_count, count[m], 0, 0, 0);
+    }
+}
+
+// The cache render has been recorded, later frames only copy it.
+void shadow_cached(AppState *app)
+{
+    ShadowCache *shadow = &app->shadow;
+    shadow->valid = true;
+    shadow->stats.rebuilds++;
+    shadow->stats.static_casters = 0;
+    for (int m = 0; m < MAX_MODELS; m++) {
+        shadow->stats.static_casters += shadow->static_count[m];
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "common.h"
+
+bool shadow_init(AppState *app);
+void shadow_release(AppState *app);
+
+bool shadow_write(AppState *app);
+void shadow_draw(AppState *app, SDL_GPURenderPass *render_pass, SDL_GPUCommandBuffer *cmd_buf, bool static_casters);
+void shadow_cached(AppState *app);
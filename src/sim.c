@@ -0,0 +1,72 @@
+#include "sim.h"
+#include "game.h"
+
+static int sim_main(void *data)
+{
+    AppState *app = data;
+    SimThread *sim = &app->sim;
+
+    for (;;) {
+        SDL_WaitSemaphore(sim->go);
+        if (sim->quit) break;
+
+        game_update(app);
+        SDL_SignalSemaphore(sim->done);
+    }
+    return 0;
+}
+
+bool sim_start(AppState *app)
+{
+    SimThread *sim = &app->sim;
+    SDL_zerop(sim);
+
+    sim->go = SDL_CreateSemaphore(0);
+    sim->done = SDL_CreateSemaphore(0);
+    if (sim->go && sim->done) {
+        sim->thread = SDL_CreateThread(sim_main, "simulation", app);
+    }
+    if (!sim->thread) {
+        SDL_Log("Failed to start simulation thread, updating inline\n%s", SDL_GetError());
+        SDL_DestroySemaphore(sim->go);
+        SDL_DestroySemaphore(sim->done);
+        SDL_zerop(sim);
+        return false;
+    }
+    return true;
+}
+
+void sim_stop(AppState *app)
+{
+    SimThread *sim = &app->sim;
+    if (sim->thread) {
+        sim_wait(app);
+        sim->quit = true;
+        SDL_SignalSemaphore(sim->go);
+        SDL_WaitThread(sim->thread, NULL);
+    }
+    SDL_DestroySemaphore(sim->go);
+    SDL_DestroySemaphore(sim->done);
+    SDL_zerop(sim);
+}
+
+// Starts the next update. Without a thread it simply runs here.
+void sim_kick(AppState *app)
+{
+    SimThread *sim = &app->sim;
+    if (!sim->thread) {
+        game_update(app);
+        return;
+    }
+    sim->busy = true;
+    SDL_SignalSemaphore(sim->go);
+}
+
+void sim_wait(AppState *app)
+{
+    SimThread *sim = &app->sim;
+    if (sim->busy) {
+        SDL_WaitSemaphore(sim->done);
+        sim->busy = false;
+    }
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include "common.h"
+
+bool sim_start(AppState *app);
+void sim_stop(AppState *app);
+void sim_kick(AppState *app);
+void sim_wait(AppState *app);
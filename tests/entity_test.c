@@ -0,0 +1,312 @@
+#include "test.h"
+#include "entity.h"
+
+static Entity make_entity(Model_ID model_id, EntityHandle parent)
+{
+    Entity entity = {
+        .model_id = model_id,
+        .rotation = { 0.0f, 0.0f, 0.0f, 1.0f },
+        .parent = parent,
+    };
+    return entity;
+}
+
+// parents ahead of children, slots and links consistent with the dense
+// arrays, per-model counts matching
+static bool store_valid(const EntityStore *store)
+{
+    Uint32 model_count[MAX_MODELS] = { 0 };
+    for (int i = 0; i < store->count; i++) {
+        Uint32 slot = store->slot[i];
+        if (store->slot_dense[slot] != (Uint32) i) return false;
+        model_count[store->model_id[i]]++;
+
+        Uint32 parent = store->parent[i];
+        if (parent != ENTITY_SLOT_NONE) {
+            if (store->slot_dense[parent] >= (Uint32) i) return false;
+            bool linked = false;
+            for (Uint32 c = store->first_child[parent]; c != ENTITY_SLOT_NONE; c = store->next_sibling[c]) {
+                if (c == slot) linked = true;
+            }
+            if (!linked) return false;
+        }
+
+        Uint32 prev = ENTITY_SLOT_NONE;
+        for (Uint32 c = store->first_child[slot]; c != ENTITY_SLOT_NONE; c = store->next_sibling[c]) {
+            if (store->prev_sibling[c] != prev) return false;
+            if (store->parent[store->slot_dense[c]] != slot) return false;
+            prev = c;
+        }
+    }
+    return SDL_memcmp(model_count, store->model_count, sizeof(model_count)) == 0;
+}
+
+static void test_handles(void)
+{
+    EntityStore store = { 0 };
+    Entity entity = make_entity(0, ENTITY_NONE);
+    EntityHandle a = entity_spawn(&store, &entity);
+    EntityHandle b = entity_spawn(&store, &entity);
+    CHECK(a.generation != 0 && b.generation != 0);
+    CHECK(entity_lookup(&store, a) == 0);
+    CHECK(entity_lookup(&store, b) == 1);
+    CHECK(entity_lookup(&store, ENTITY_NONE) < 0);
+
+    // a despawned handle goes stale and stays stale when its slot is reused
+    CHECK(entity_despawn(&store, a));
+    CHECK(entity_lookup(&store, a) < 0);
+    CHECK(!entity_despawn(&store, a));
+    CHECK(entity_lookup(&store, b) == 0);
+
+    EntityHandle c = entity_spawn(&store, &entity);
+    CHECK(c.slot == a.slot && c.generation != a.generation);
+    CHECK(entity_lookup(&store, a) < 0);
+    CHECK(entity_lookup(&store, c) == 1);
+    CHECK(entity_handle(&store, 1).slot == c.slot);
+    CHECK(entity_handle(&store, 1).generation == c.generation);
+
+    // spawns are refused for stale parents and bad models
+    entity = make_entity(0, a);
+    CHECK(entity_spawn(&store, &entity).generation == 0);
+    entity = make_entity(MAX_MODELS, ENTITY_NONE);
+    CHECK(entity_spawn(&store, &entity).generation == 0);
+    CHECK(store.count == 2);
+    CHECK(store_valid(&store));
+    entity_store_release(&store);
+}
+
+static void test_despawn_children(void)
+{
+    EntityStore store = { 0 };
+    Entity entity = make_entity(0, ENTITY_NONE);
+    EntityHandle root = entity_spawn(&store, &entity);
+    EntityHandle other = entity_spawn(&store, &entity);
+    entity = make_entity(1, root);
+    EntityHandle child = entity_spawn(&store, &entity);
+    EntityHandle sibling = entity_spawn(&store, &entity);
+    entity = make_entity(2, child);
+    EntityHandle grandchild = entity_spawn(&store, &entity);
+    entity = make_entity(1, other);
+    EntityHandle kept = entity_spawn(&store, &entity);
+    CHECK(store_valid(&store));
+
+    // the whole subtree goes, nothing else
+    CHECK(entity_despawn(&store, root));
+    CHECK(entity_lookup(&store, child) < 0);
+    CHECK(entity_lookup(&store, sibling) < 0);
+    CHECK(entity_lookup(&store, grandchild) < 0);
+    CHECK(entity_lookup(&store, other) >= 0);
+    CHECK(entity_lookup(&store, kept) >= 0);
+    CHECK(store.count == 2);
+    CHECK(store.model_count[0] == 1 && store.model_count[1] == 1 && store.model_count[2] == 0);
+    CHECK(store_valid(&store));
+    entity_store_release(&store);
+}
+
+// random spawns and despawns keep parents ahead of their children
+static void test_order(void)
+{
+    EntityStore store = { 0 };
+    EntityHandle handles[256];
+    int handle_count = 0;
+    Uint32 seed = 1;
+    bool valid = true;
+
+    for (int step = 0; step < 4000; step++) {
+        seed = seed * 1664525u + 1013904223u;
+        Uint32 r = seed >> 8;
+        if (handle_count < (int) SDL_arraysize(handles) && (r % 3 != 0 || handle_count == 0)) {
+            EntityHandle parent = ENTITY_NONE;
+            if (handle_count > 0 && r % 4 != 0) parent = handles[(r >> 4) % handle_count];
+            Entity entity = make_entity((Model_ID) (r % MAX_MODELS), parent);
+            EntityHandle handle = entity_spawn(&store, &entity);
+            if (handle.generation != 0) handles[handle_count++] = handle;
+        } else {
+            entity_despawn(&store, handles[(r >> 4) % handle_count]);
+        }
+
+        // forget the handles that went stale
+        for (int h = 0; h < handle_count; h++) {
+            if (entity_lookup(&store, handles[h]) < 0) handles[h--] = handles[--handle_count];
+        }
+        if (handle_count != store.count || !store_valid(&store)) valid = false;
+    }
+    CHECK(valid);
+    entity_store_release(&store);
+}
+
+// the world matrix composed from scratch up the parent chain
+static void expected_world(const EntityStore *store, int i, mat3x4 dest)
+{
+    mat3x4_from_trs(store->position[i], store->rotation[i], VEC3_ONE, dest);
+    for (Uint32 p = store->parent[i]; p != ENTITY_SLOT_NONE; p = store->parent[store->slot_dense[p]]) {
+        int parent = (int) store->slot_dense[p];
+        mat3x4 local;
+        mat3x4_from_trs(store->position[parent], store->rotation[parent], VEC3_ONE, local);
+        mat3x4_mul(local, dest, dest);
+    }
+}
+
+static bool worlds_valid(const EntityStore *store)
+{
+    for (int i = 0; i < store->count; i++) {
+        mat3x4 expected;
+        expected_world(store, i, expected);
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 4; c++) {
+                if (SDL_fabsf(expected[r][c] - store->world[i][r][c]) > 1e-3f) return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void test_transforms(void)
+{
+    EntityStore store = { 0 };
+    Entity entity = make_entity(0, ENTITY_NONE);
+    EntityHandle root = entity_spawn(&store, &entity);
+    entity = make_entity(0, root);
+    entity.position[1] = 1.0f;
+    EntityHandle child = entity_spawn(&store, &entity);
+    EntityHandle sibling = entity_spawn(&store, &entity);
+    entity = make_entity(0, child);
+    entity.position[0] = 2.0f;
+    EntityHandle grandchild = entity_spawn(&store, &entity);
+    entity_update_transforms(&store);
+    CHECK(worlds_valid(&store));
+    CHECK(store.dirty_count == 0);
+
+    // a moved parent carries the whole subtree
+    int r = entity_lookup(&store, root);
+    store.position[r][2] = 5.0f;
+    quat_angle_axis(0.5f, (vec3){ 0.0f, 1.0f, 0.0f }, store.rotation[r]);
+    entity_moved(&store, r);
+    int c = entity_lookup(&store, child);
+    quat_angle_axis(1.0f, (vec3){ 1.0f, 0.0f, 0.0f }, store.rotation[c]);
+    entity_moved(&store, c);
+    entity_update_transforms(&store);
+    CHECK(worlds_valid(&store));
+
+    // a moved leaf leaves its siblings alone
+    int s = entity_lookup(&store, sibling);
+    mat3x4 sibling_world;
+    SDL_memcpy(sibling_world, store.world[s], sizeof(mat3x4));
+    SDL_memset(store.world[s], 0, sizeof(mat3x4));
+    int g = entity_lookup(&store, grandchild);
+    store.position[g][0] = -3.0f;
+    entity_moved(&store, g);
+    entity_update_transforms(&store);
+    CHECK(store.world[s][0][0] == 0.0f);
+    SDL_memcpy(store.world[s], sibling_world, sizeof(mat3x4));
+    CHECK(worlds_valid(&store));
+
+    // random moves, spawns and despawns against the from-scratch result
+    EntityHandle handles[128];
+    int handle_count = 0;
+    for (int i = 0; i < store.count; i++) handles[handle_count++] = entity_handle(&store, i);
+    Uint32 seed = 7;
+    bool valid = true;
+    for (int frame = 0; frame < 500; frame++) {
+        for (int k = 0; k < 4; k++) {
+            seed = seed * 1664525u + 1013904223u;
+            Uint32 v = seed >> 8;
+            if (v % 5 == 0 && handle_count > 1) {
+                entity_despawn(&store, handles[(v >> 4) % handle_count]);
+            } else if (v % 5 == 1 && handle_count < (int) SDL_arraysize(handles)) {
+                entity = make_entity(0, handle_count > 0 ? handles[(v >> 4) % handle_count] : ENTITY_NONE);
+                entity.position[0] = (float) (v % 7);
+                EntityHandle handle = entity_spawn(&store, &entity);
+                if (handle.generation != 0) handles[handle_count++] = handle;
+            } else if (handle_count > 0) {
+                int e = entity_lookup(&store, handles[(v >> 4) % handle_count]);
+                store.position[e][1] += 0.25f;
+                quat_angle_axis((float) (v % 13) * 0.1f, (vec3){ 0.0f, 0.0f, 1.0f }, store.rotation[e]);
+                entity_moved(&store, e);
+            }
+            for (int h = 0; h < handle_count; h++) {
+                if (entity_lookup(&store, handles[h]) < 0) handles[h--] = handles[--handle_count];
+            }
+        }
+        entity_update_transforms(&store);
+        if (!worlds_valid(&store) || store.dirty_count != 0) valid = false;
+    }
+    CHECK(valid);
+    entity_store_release(&store);
+}
+
+static bool stores_match(const EntityStore *a, const EntityStore *b)
+{
+    if (a->count != b->count || a->slot_count != b->slot_count) return false;
+    for (int i = 0; i < a->count; i++) {
+        if (a->slot[i] != b->slot[i] || a->parent[i] != b->parent[i] || a->material[i] != b->material[i]) return false;
+        if (SDL_memcmp(a->world[i], b->world[i], sizeof(mat3x4)) != 0) return false;
+    }
+    for (int s = 0; s < a->slot_count; s++) {
+        if (a->slot_generation[s] != b->slot_generation[s]) return false;
+    }
+    return SDL_memcmp(a->model_count, b->model_count, sizeof(a->model_count)) == 0;
+}
+
+// the copy only takes the changed range and still ends up equal
+static void test_copy(void)
+{
+    EntityStore store = { 0 };
+    EntityStore snapshot = { 0 };
+    EntityHandle handles[64];
+    int handle_count = 0;
+    Entity entity = make_entity(0, ENTITY_NONE);
+    entity.flags = ENTITY_STATIC;
+    for (int i = 0; i < 16; i++) entity_spawn(&store, &entity);
+    entity_update_transforms(&store);
+    CHECK(entity_store_copy(&snapshot, &store));
+    CHECK(stores_match(&snapshot, &store));
+    CHECK(store.changed_first >= store.changed_end);
+
+    // nothing moved, nothing to copy
+    entity_store_clear_changes(&snapshot);
+    CHECK(entity_store_copy(&snapshot, &store));
+    CHECK(snapshot.changed_first >= snapshot.changed_end);
+
+    Uint32 seed = 3;
+    bool valid = true;
+    for (int frame = 0; frame < 300; frame++) {
+        seed = seed * 1664525u + 1013904223u;
+        Uint32 v = seed >> 8;
+        if (v % 3 == 0 && handle_count < (int) SDL_arraysize(handles)) {
+            entity = make_entity(1, handle_count > 0 && v % 2 ? handles[(v >> 4) % handle_count] : ENTITY_NONE);
+            EntityHandle handle = entity_spawn(&store, &entity);
+            if (handle.generation != 0) handles[handle_count++] = handle;
+        } else if (v % 3 == 1 && handle_count > 0) {
+            entity_despawn(&store, handles[(v >> 4) % handle_count]);
+        } else if (handle_count > 0) {
+            int e = entity_lookup(&store, handles[(v >> 4) % handle_count]);
+            store.position[e][0] += 1.0f;
+            entity_moved(&store, e);
+        }
+        for (int h = 0; h < handle_count; h++) {
+            if (entity_lookup(&store, handles[h]) < 0) handles[h--] = handles[--handle_count];
+        }
+        entity_update_transforms(&store);
+
+        // the static entities spawned first are never copied again
+        entity_store_clear_changes(&snapshot);
+        if (!entity_store_copy(&snapshot, &store) || !stores_match(&snapshot, &store)) valid = false;
+        if (snapshot.changed_first < snapshot.changed_end && snapshot.changed_first < 16) valid = false;
+    }
+    CHECK(valid);
+    entity_store_release(&store);
+    entity_store_release(&snapshot);
+}
+
+int main(int argc, char *argv[])
+{
+    (void) argc;
+    (void) argv;
+    test_handles();
+    test_despawn_children();
+    test_order();
+    test_transforms();
+    test_copy();
+    return TEST_RESULT();
+}
@@ -0,0 +1,82 @@
+#include "test.h"
+#include "linalg.h"
+
+static bool near(float a, float b)
+{
+    return SDL_fabsf(a - b) < 1e-4f;
+}
+
+static bool vec3_near(const vec3 a, const vec3 b)
+{
+    return near(a[0], b[0]) && near(a[1], b[1]) && near(a[2], b[2]);
+}
+
+// from_trs scales, then rotates, then translates
+static void test_from_trs(void)
+{
+    quat r;
+    quat_angle_axis(1.0f, (vec3){ 0.0f, 1.0f, 0.0f }, r);
+    vec3 t = { 1.0f, 2.0f, 3.0f };
+    vec3 s = { 2.0f, 3.0f, 4.0f };
+    mat3x4 m;
+    mat3x4_from_trs(t, r, s, m);
+
+    vec3 p = { 0.5f, -1.0f, 2.0f };
+    vec3 expected = { p[0] * s[0], p[1] * s[1], p[2] * s[2] };
+    quat_rotatev(r, expected, expected);
+    vec3_add(expected, t, expected);
+
+    vec3 got;
+    mat3x4_mulv3(m, p, got);
+    CHECK(vec3_near(got, expected));
+}
+
+// m1 * m2 applies m2 first, and dest may be either operand
+static void test_mul(void)
+{
+    quat r1, r2;
+    quat_angle_axis(0.7f, (vec3){ 0.0f, 0.0f, 1.0f }, r1);
+    quat_angle_axis(-1.3f, (vec3){ 1.0f, 0.0f, 0.0f }, r2);
+    mat3x4 parent, child, world;
+    mat3x4_from_trs((vec3){ 4.0f, 0.0f, -2.0f }, r1, (vec3){ 2.0f, 2.0f, 2.0f }, parent);
+    mat3x4_from_trs((vec3){ 0.0f, 1.0f, 0.0f }, r2, (vec3){ 1.0f, 0.5f, 1.0f }, child);
+    mat3x4_mul(parent, child, world);
+
+    vec3 p = { 1.0f, 2.0f, 3.0f };
+    vec3 expected, got;
+    mat3x4_mulv3(child, p, expected);
+    mat3x4_mulv3(parent, expected, expected);
+    mat3x4_mulv3(world, p, got);
+    CHECK(vec3_near(got, expected));
+
+    // directions skip the translation
+    mat3x4_mulv3_dir(child, p, expected);
+    mat3x4_mulv3_dir(parent, expected, expected);
+    mat3x4_mulv3_dir(world, p, got);
+    CHECK(vec3_near(got, expected));
+
+    mat3x4 identity = {
+        { 1.0f, 0.0f, 0.0f, 0.0f },
+        { 0.0f, 1.0f, 0.0f, 0.0f },
+        { 0.0f, 0.0f, 1.0f, 0.0f },
+    };
+    mat3x4 same;
+    mat3x4_mul(identity, parent, same);
+    CHECK(SDL_memcmp(same, parent, sizeof(mat3x4)) == 0);
+
+    mat3x4 in_place;
+    SDL_memcpy(in_place, parent, sizeof(mat3x4));
+    mat3x4_mul(in_place, child, in_place);
+    mat3x4_mulv3(in_place, p, got);
+    mat3x4_mulv3(world, p, expected);
+    CHECK(vec3_near(got, expected));
+}
+
+int main(int argc, char *argv[])
+{
+    (void) argc;
+    (void) argv;
+    test_from_trs();
+    test_mul();
+    return TEST_RESULT();
+}
@@ -0,0 +1,148 @@
+#include "test.h"
+#include "rendergraph.h"
+#include "rtpool.h"
+
+static const RenderTargetDesc color_desc = {
+    .format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM,
+    .usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET | SDL_GPU_TEXTUREUSAGE_SAMPLER,
+    .width = 256,
+    .height = 256,
+    .num_levels = 1,
+    .sample_count = SDL_GPU_SAMPLECOUNT_1,
+};
+
+static const SDL_FColor black = { 0, 0, 0, 1 };
+
+// a pass whose output nothing reads is dropped, so is one whose output a
+// later clear throws away
+static void test_culling(void)
+{
+    RenderGraph graph;
+    RenderTargetPool pool;
+    rt_pool_init(&pool);
+    render_graph_begin(&graph);
+
+    int scene = render_graph_create(&graph, "scene", &color_desc);
+    int unused = render_graph_create(&graph, "unused", &color_desc);
+    render_graph_export(&graph, scene);
+
+    int overdrawn = render_graph_add_pass(&graph, "overdrawn", GRAPH_PASS_RENDER, NULL, NULL);
+    render_graph_color(&graph, overdrawn, scene, &black);
+    int orphan = render_graph_add_pass(&graph, "orphan", GRAPH_PASS_RENDER, NULL, NULL);
+    render_graph_color(&graph, orphan, unused, &black);
+    int kept = render_graph_add_pass(&graph, "kept", GRAPH_PASS_CUSTOM, NULL, NULL);
+    render_graph_keep(&graph, kept);
+    int draw = render_graph_add_pass(&graph, "draw", GRAPH_PASS_RENDER, NULL, NULL);
+    render_graph_color(&graph, draw, scene, &black);
+    int overlay = render_graph_add_pass(&graph, "overlay", GRAPH_PASS_RENDER, NULL, NULL);
+    render_graph_color(&graph, overlay, scene, NULL);
+
+    CHECK(render_graph_compile(NULL, &graph, &pool));
+    CHECK(!graph.passes[overdrawn].live);
+    CHECK(!graph.passes[orphan].live);
+    CHECK(graph.passes[kept].live);
+    CHECK(graph.passes[draw].live);
+    CHECK(graph.passes[overlay].live);
+    CHECK(graph.stats.culled == 2);
+    CHECK(graph.resources[unused].texture == NULL);
+
+    CHECK(render_graph_load_op(&graph, draw, scene) == SDL_GPU_LOADOP_CLEAR);
+    CHECK(render_graph_store_op(&graph, draw, scene) == SDL_GPU_STOREOP_STORE);
+    CHECK(render_graph_load_op(&graph, overlay, scene) == SDL_GPU_LOADOP_LOAD);
+    CHECK(render_graph_store_op(&graph, overlay, scene) == SDL_GPU_STOREOP_STORE);
+}
+
+// a cleared attachment is dead before the clear, so the pass before it has
+// no reason to store
+static void test_clear_discards(void)
+{
+    RenderGraph graph;
+    RenderTargetPool pool;
+    rt_pool_init(&pool);
+    render_graph_begin(&graph);
+
+    int scene = render_graph_create(&graph, "scene", &color_desc);
+    int shadow = render_graph_create(&graph, "shadow", &color_desc);
+    render_graph_export(&graph, scene);
+
+    int first = render_graph_add_pass(&graph, "first", GRAPH_PASS_RENDER, NULL, NULL);
+    render_graph_color(&graph, first, scene, &black);
+    render_graph_color(&graph, first, shadow, &black);
+    int second = render_graph_add_pass(&graph, "second", GRAPH_PASS_RENDER, NULL, NULL);
+    render_graph_color(&graph, second, scene, NULL);
+    render_graph_read(&graph, second, shadow);
+    int third = render_graph_add_pass(&graph, "third", GRAPH_PASS_RENDER, NULL, NULL);
+    render_graph_color(&graph, third, shadow, &black);
+    render_graph_keep(&graph, third);
+
+    CHECK(render_graph_compile(NULL, &graph, &pool));
+    CHECK(graph.passes[first].live && graph.passes[second].live && graph.passes[third].live);
+    CHECK(render_graph_store_op(&graph, first, shadow) == SDL_GPU_STOREOP_STORE);
+    CHECK(render_graph_load_op(&graph, third, shadow) == SDL_GPU_LOADOP_CLEAR);
+    CHECK(render_graph_store_op(&graph, third, shadow) == SDL_GPU_STOREOP_DONT_CARE);
+}
+
+// transients with the same desc share a texture once the first is done
+static void test_aliasing(void)
+{
+    RenderGraph graph;
+    RenderTargetPool pool;
+    rt_pool_init(&pool);
+    render_graph_begin(&graph);
+
+    int a = render_graph_create(&graph, "a", &color_desc);
+    int b = render_graph_create(&graph, "b", &color_desc);
+    int c = render_graph_create(&graph, "c", &color_desc);
+    int d = render_graph_create(&graph, "d", &color_desc);
+    render_graph_export(&graph, d);
+
+    // a -> b, b -> c, c -> d: a is free once b is written, b once c is
+    int pass = render_graph_add_pass(&graph, "make a", GRAPH_PASS_RENDER, NULL, NULL);
+    render_graph_color(&graph, pass, a, &black);
+    pass = render_graph_add_pass(&graph, "a to b", GRAPH_PASS_RENDER, NULL, NULL);
+    render_graph_read(&graph, pass, a);
+    render_graph_color(&graph, pass, b, &black);
+    pass = render_graph_add_pass(&graph, "b to c", GRAPH_PASS_RENDER, NULL, NULL);
+    render_graph_read(&graph, pass, b);
+    render_graph_color(&graph, pass, c, &black);
+    pass = render_graph_add_pass(&graph, "c to d", GRAPH_PASS_RENDER, NULL, NULL);
+    render_graph_read(&graph, pass, c);
+    render_graph_color(&graph, pass, d, &black);
+
+    CHECK(render_graph_compile(NULL, &graph, &pool));
+    CHECK(graph.stats.culled == 0);
+    CHECK(graph.stats.transient == 4);
+    CHECK(graph.stats.textures == 2);
+    CHECK(graph.stats.aliased == 2);
+    CHECK(render_graph_texture(&graph, a) == render_graph_texture(&graph, c));
+    CHECK(render_graph_texture(&graph, b) == render_graph_texture(&graph, d));
+    CHECK(render_graph_texture(&graph, a) != render_graph_texture(&graph, b));
+    CHECK(pool.count == 2);
+
+    // a different desc never shares
+    render_graph_begin(&graph);
+    RenderTargetDesc half_desc = color_desc;
+    half_desc.width /= 2;
+    a = render_graph_create(&graph, "a", &color_desc);
+    b = render_graph_create(&graph, "b", &half_desc);
+    render_graph_export(&graph, b);
+    pass = render_graph_add_pass(&graph, "make a", GRAPH_PASS_RENDER, NULL, NULL);
+    render_graph_color(&graph, pass, a, &black);
+    pass = render_graph_add_pass(&graph, "a to b", GRAPH_PASS_RENDER, NULL, NULL);
+    render_graph_read(&graph, pass, a);
+    render_graph_color(&graph, pass, b, &black);
+
+    CHECK(render_graph_compile(NULL, &graph, &pool));
+    CHECK(graph.stats.aliased == 0);
+    CHECK(graph.stats.textures == 2);
+}
+
+int main(int argc, char *argv[])
+{
+    (void) argc;
+    (void) argv;
+    test_culling();
+    test_clear_discards();
+    test_aliasing();
+    return TEST_RESULT();
+}
@@ -0,0 +1,95 @@
+#include "test.h"
+#include "rtpool.h"
+
+static const RenderTargetDesc color_desc = {
+    .format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM,
+    .usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET,
+    .width = 256,
+    .height = 256,
+    .num_levels = 1,
+    .sample_count = SDL_GPU_SAMPLECOUNT_1,
+};
+
+// ends the frame without a fence and marks everything up to it done, the
+// way a signaled fence would
+static void finish_frame(RenderTargetPool *pool)
+{
+    rt_pool_end_frame(NULL, pool, NULL);
+    pool->completed = pool->frame - 1;
+}
+
+static void test_recycling(void)
+{
+    RenderTargetPool pool;
+    rt_pool_init(&pool);
+
+    // each target is handed out once per frame
+    rt_pool_begin_frame(NULL, &pool);
+    SDL_GPUTexture *a = rt_pool_acquire(NULL, &pool, &color_desc, "a");
+    SDL_GPUTexture *b = rt_pool_acquire(NULL, &pool, &color_desc, "b");
+    CHECK(a && b && a != b);
+    CHECK(pool.stats.created == 2);
+
+    // still in flight, so the next frame gets new ones
+    rt_pool_end_frame(NULL, &pool, NULL);
+    rt_pool_begin_frame(NULL, &pool);
+    SDL_GPUTexture *c = rt_pool_acquire(NULL, &pool, &color_desc, "c");
+    CHECK(c != a && c != b);
+    CHECK(pool.stats.created == 3);
+
+    // once the gpu is done they come back
+    finish_frame(&pool);
+    rt_pool_begin_frame(NULL, &pool);
+    SDL_GPUTexture *d = rt_pool_acquire(NULL, &pool, &color_desc, "d");
+    SDL_GPUTexture *e = rt_pool_acquire(NULL, &pool, &color_desc, "e");
+    CHECK(d == a || d == b || d == c);
+    CHECK(e == a || e == b || e == c);
+    CHECK(d != e);
+    CHECK(pool.stats.created == 3);
+
+    // a different desc never matches
+    RenderTargetDesc half_desc = color_desc;
+    half_desc.width /= 2;
+    SDL_GPUTexture *f = rt_pool_acquire(NULL, &pool, &half_desc, "f");
+    CHECK(f != a && f != b && f != c);
+    CHECK(pool.stats.created == 4);
+}
+
+static void test_retire(void)
+{
+    RenderTargetPool pool;
+    rt_pool_init(&pool);
+
+    rt_pool_begin_frame(NULL, &pool);
+    Uint64 used = pool.frame;
+    CHECK(rt_pool_acquire(NULL, &pool, &color_desc, "a") != NULL);
+    finish_frame(&pool);
+
+    // kept while it might be wanted again, released once unused for long
+    while (pool.frame < used + RT_POOL_RETIRE_FRAMES) {
+        rt_pool_begin_frame(NULL, &pool);
+        CHECK(pool.count == 1);
+        finish_frame(&pool);
+    }
+    rt_pool_begin_frame(NULL, &pool);
+    CHECK(pool.count == 0);
+    CHECK(pool.stats.released == 1);
+}
+
+static void test_size(void)
+{
+    CHECK(rt_pool_size(0) == RT_POOL_SIZE_STEP);
+    CHECK(rt_pool_size(1) == RT_POOL_SIZE_STEP);
+    CHECK(rt_pool_size(RT_POOL_SIZE_STEP) == RT_POOL_SIZE_STEP);
+    CHECK(rt_pool_size(RT_POOL_SIZE_STEP + 1) == 2 * RT_POOL_SIZE_STEP);
+}
+
+int main(int argc, char *argv[])
+{
+    (void) argc;
+    (void) argv;
+    test_recycling();
+    test_retire();
+    test_size();
+    return TEST_RESULT();
+}
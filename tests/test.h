@@ -0,0 +1,17 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+// Minimal checks for the unit tests: a failed check logs where it failed
+// and the test returns nonzero at the end.
+static int test_failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            SDL_Log("%s:%d: check failed: %s", __FILE__, __LINE__, #cond);  \
+            test_failures++;                                                \
+        }                                                                   \
+    } while (0)
+
+#define TEST_RESULT() (test_failures == 0 ? 0 : 1)
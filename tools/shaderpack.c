@@ -0,0 +1,137 @@
+// Bundles every compiled shader in a directory into one shader pack.
+//
+//   shaderpack [shader dir] [output file]
+//
+// For each <name>.json reflection file the matching <name>.spv, <name>.dxil
+// and <name>.msl blobs are packed with the reflection counts, so the app can
+// create shaders without opening or parsing anything else at runtime.
+
+#include <SDL3/SDL.h>
+#include "shader.h"
+
+#define PACK_ALIGN 16
+
+typedef struct {
+    ShaderPackEntry entry;
+    void *code;
+} PackItem;
+
+static const struct {
+    SDL_GPUShaderFormat format;
+    const char *ext;
+} formats[] = {
+    { SDL_GPU_SHADERFORMAT_SPIRV, "spv"  },
+    { SDL_GPU_SHADERFORMAT_DXIL,  "dxil" },
+    { SDL_GPU_SHADERFORMAT_MSL,   "msl"  },
+};
+
+static int compare_items(const void *a, const void *b)
+{
+    const ShaderPackEntry *ea = &((const PackItem *) a)->entry;
+    const ShaderPackEntry *eb = &((const PackItem *) b)->entry;
+    if (ea->name_hash != eb->name_hash) return ea->name_hash < eb->name_hash ? -1 : 1;
+    if (ea->format != eb->format) return ea->format < eb->format ? -1 : 1;
+    return SDL_strcmp(ea->name, eb->name);
+}
+
+int main(int argc, char **argv)
+{
+    const char *shader_dir = argc > 1 ? argv[1] : "assets/shaders/out";
+    const char *out_path   = argc > 2 ? argv[2] : SHADER_PACK_PATH;
+
+    int json_count = 0;
+    char **json_files = SDL_GlobDirectory(shader_dir, "*.json", 0, &json_count);
+    if (!json_files) {
+        SDL_Log("Failed to list %s\n%s", shader_dir, SDL_GetError());
+        return 1;
+    }
+
+    PackItem *items = SDL_calloc((size_t) json_count * SDL_arraysize(formats), sizeof *items);
+    if (!items && json_count) {
+        SDL_Log("Failed to allocate pack items");
+        return 1;
+    }
+
+    Uint32 item_count = 0;
+    for (int i = 0; i < json_count; i++) {
+        // "shader.vert.json" -> "shader.vert"
+        char name[SHADER_NAME_LEN];
+        size_t name_len = SDL_strlen(json_files[i]) - SDL_strlen(".json");
+        if (name_len >= sizeof(name)) {
+            SDL_Log("Shader name too long: %s", json_files[i]);
+            return 1;
+        }
+        SDL_memcpy(name, json_files[i], name_len);
+        name[name_len] = '\0';
+
+        char basepath[256];
+        SDL_snprintf(basepath, sizeof(basepath), "%s/%s", shader_dir, name);
+        ShaderInfo info = load_shader_info(basepath);
+
+        for (size_t f = 0; f < SDL_arraysize(formats); f++) {
+            char codepath[256];
+            SDL_snprintf(codepath, sizeof(codepath), "%s.%s", basepath, formats[f].ext);
+
+            size_t code_size = 0;
+            void *code = SDL_LoadFile(codepath, &code_size);
+            if (!code) continue;
+
+            PackItem *item = &items[item_count++];
+            SDL_strlcpy(item->entry.name, name, sizeof(item->entry.name));
+            item->entry.name_hash = shader_name_hash(name);
+            item->entry.format = formats[f].format;
+            item->entry.size = (Uint32) code_size;
+            item->entry.info = info;
+            item->code = code;
+        }
+    }
+    SDL_free(json_files);
+
+    SDL_qsort(items, item_count, sizeof *items, compare_items);
+
+    Uint32 offset = (Uint32) (sizeof(ShaderPackHeader) + item_count * sizeof(ShaderPackEntry));
+    for (Uint32 i = 0; i < item_count; i++) {
+        offset = (offset + PACK_ALIGN - 1) & ~(Uint32) (PACK_ALIGN - 1);
+        items[i].entry.offset = offset;
+        offset += items[i].entry.size;
+    }
+
+    SDL_IOStream *out = SDL_IOFromFile(out_path, "wb");
+    if (!out) {
+        SDL_Log("Failed to open %s\n%s", out_path, SDL_GetError());
+        return 1;
+    }
+
+    ShaderPackHeader header = {
+        .magic = SHADER_PACK_MAGIC,
+        .version = SHADER_PACK_VERSION,
+        .entry_count = item_count,
+    };
+    bool ok = SDL_WriteIO(out, &header, sizeof(header)) == sizeof(header);
+    for (Uint32 i = 0; ok && i < item_count; i++) {
+        ok = SDL_WriteIO(out, &items[i].entry, sizeof(ShaderPackEntry)) == sizeof(ShaderPackEntry);
+    }
+
+    static const Uint8 zeros[PACK_ALIGN] = {0};
+    Uint32 written = (Uint32) (sizeof(ShaderPackHeader) + item_count * sizeof(ShaderPackEntry));
+    for (Uint32 i = 0; ok && i < item_count; i++) {
+        Uint32 padding = items[i].entry.offset - written;
+        ok = SDL_WriteIO(out, zeros, padding) == padding &&
+             SDL_WriteIO(out, items[i].code, items[i].entry.size) == items[i].entry.size;
+        written = items[i].entry.offset + items[i].entry.size;
+    }
+
+    SDL_CloseIO(out);
+    for (Uint32 i = 0; i < item_count; i++) {
+        SDL_free(items[i].code);
+    }
+    SDL_free(items);
+
+    if (!ok) {
+        SDL_Log("Failed to write %s\n%s", out_path, SDL_GetError());
+        return 1;
+    }
+
+    SDL_Log("Packed %u shaders into %s (%u bytes)", item_count, out_path, written);
+    return 0;
+}